@@ -0,0 +1,71 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+// Physical addresses: [floor, top) is free, [top, limit) handed out
+static uint32_t bottom, top, limit;
+
+void arena_init(uint32_t memsize) {
+  limit = (memsize - ARENA_STACK) & ~(ARENA_ALIGN - 1);
+  bottom = (PhysicalAddr(sbrk(0)) + ARENA_HEAP_SLACK + ARENA_ALIGN - 1) &
+           ~(ARENA_ALIGN - 1);
+  top = limit;
+
+  if (bottom > top)
+    bottom = top;
+}
+
+// Never returns NULL: running out here is a build problem, so halt
+void *arena_alloc(uint32_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (size > top - bottom) {
+    printf("Out of staging memory for %lu bytes, halting...\n",
+           (unsigned long)size);
+
+    while (1)
+      ;
+  }
+
+  top -= size;
+  return (void *)(0x80000000 | top);
+}
+
+/* Reserve len bytes at addr for a payload. Returns -1 if that overlaps a
+ * buffer already handed out; otherwise later buffers stay above it. */
+int arena_claim(uint32_t addr, uint32_t len) {
+  const uint32_t start = PhysicalAddr(addr), end = start + len;
+
+  if (start < limit && end > top)
+    return -1;
+
+  if (end > bottom)
+    bottom = end < top ? end : top;
+  return 0;
+}
+
+uint32_t arena_used(void) { return limit - top; }
+
+uint32_t arena_free(void) { return top - bottom; }
+
+// Physical end of the buffers, where the stack begins
+uint32_t arena_limit(void) { return limit; }
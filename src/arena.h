@@ -0,0 +1,48 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Staging arena for loader buffers.
+ *
+ * DMA staging, headers, tables and scratch space all come from one window
+ * of RAM between the heap libdragon already uses and the stack at the top
+ * of RAM, sized from the detected memory. Buffers are handed out from the
+ * top down and never freed. Payload destinations are claimed before they
+ * are written, which fails if they would land on a buffer already handed
+ * out, and keeps later buffers clear of them. */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+/* Kept free below the top of RAM for the stack */
+#define ARENA_STACK (64 * 1024)
+
+/* Kept free above the heap for anything libdragon still mallocs */
+#define ARENA_HEAP_SLACK (32 * 1024)
+
+/* Buffers are cache-line aligned so DMA can target them directly */
+#define ARENA_ALIGN 16
+
+void arena_init(uint32_t memsize);
+void *arena_alloc(uint32_t size);
+int arena_claim(uint32_t addr, uint32_t len);
+uint32_t arena_used(void);
+uint32_t arena_free(void);
+uint32_t arena_limit(void);
+
+#endif
@@ -0,0 +1,74 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+
+#include "boottab.h"
+
+static const uint8_t *boottab;
+static unsigned boottab_size;
+
+/* page is the 4 KB boot table page as read from the cart, and stays in
+ * use. Returns 0 when the ROM carries a boot table. */
+int boottab_load(const void *page) {
+  const struct boottab_hdr *const hdr = page;
+
+  if (hdr->magic != BOOTTAB_MAGIC || hdr->version != BOOTTAB_VERSION ||
+      hdr->size < sizeof(*hdr) || hdr->size > BOOTTAB_MAX)
+    return -1;
+
+  boottab = page;
+  boottab_size = hdr->size;
+  return 0;
+}
+
+const void *boottab_find(unsigned tag, unsigned *len) {
+  unsigned off = sizeof(struct boottab_hdr);
+
+  while (off + sizeof(struct boottab_rec) <= boottab_size) {
+    const struct boottab_rec *const rec =
+        (const struct boottab_rec *)(boottab + off);
+    const unsigned body = off + sizeof(*rec);
+
+    if (body + rec->len > boottab_size)
+      break;
+
+    if (rec->tag == tag) {
+      if (len)
+        *len = rec->len;
+      return boottab + body;
+    }
+
+    off = body + ((rec->len + 3) & ~3);
+  }
+
+  return NULL;
+}
+
+const struct bt_payload *payload_find(unsigned id) {
+  unsigned len, i;
+
+  const struct bt_payload *const pl = boottab_find(BT_LAYOUT, &len);
+  if (!pl)
+    return NULL;
+
+  for (i = 0; i < len / sizeof(*pl); i++)
+    if (pl[i].id == id)
+      return &pl[i];
+
+  return NULL;
+}
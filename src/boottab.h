@@ -0,0 +1,152 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Boot table.
+ *
+ * The 4 KB page of the ROM right below the kernel, which ends in the disk
+ * and kernel size words, holds a list of tagged records written by the
+ * packing tools in util/. Each record is a 4-byte tag/length header and a
+ * body padded to 4 bytes. Unknown tags are skipped, so old loaders keep
+ * booting newer ROMs. Shared with the host tools; all fields are
+ * big-endian. */
+
+#ifndef BOOTTAB_H
+#define BOOTTAB_H
+
+#include <stdint.h>
+
+/* Cart address of the table, and its room up to the size words */
+#define BOOTTAB_ADDR 0xB0100000
+#define BOOTTAB_MAX 0xFF8
+
+/* Offset of the table for n64tool, which counts from the end of the
+ * 4 KB ROM header */
+#define BOOTTAB_TOOL_OFFSET 0xFF000
+
+#define BOOTTAB_MAGIC 0x4E363442 /* "N64B" */
+#define BOOTTAB_VERSION 1
+
+struct boottab_hdr {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size; /* bytes, including this header */
+};
+
+struct boottab_rec {
+  uint16_t tag;
+  uint16_t len; /* body bytes, excluding padding */
+};
+
+/* Record tags. Append only. */
+#define BT_VERITY 1
+#define BT_LAYOUT 2
+#define BT_VARIANTS 3
+
+/* dm-verity hash tree appended to the disk, see util/mkverity */
+struct bt_verity {
+  uint32_t data_blocks; /* number of data blocks */
+  uint32_t hash_start;  /* first hash block, in blocks from the disk start */
+  uint16_t block_size;  /* data and hash block size */
+  uint8_t salt_len;
+  uint8_t pad;
+  uint8_t root[32]; /* sha256 root hash */
+  uint8_t salt[32];
+};
+
+/* Payload placement chosen by util/romlayout. The layout record is an
+ * array of these; without it the loader falls back to the fixed layout of
+ * the kernel at 1 MB and the disk on the next 4 KB boundary after it. */
+struct bt_payload {
+  uint16_t id;     /* PL_* */
+  uint16_t flags;  /* PL_F_* */
+  uint32_t offset; /* from the start of the ROM */
+  uint32_t size;   /* bytes */
+};
+
+/* Disk variants sharing one deduplicated chunk store, see util/cdcstore.
+ * The variants record is an array of these. The disk payload is then the
+ * store, and every variant reads as its chunks laid out in the order its
+ * chunk map in the diskmap payload lists them. */
+struct bt_variant {
+  char name[16]; /* NUL padded */
+  uint8_t tv;    /* TV type it is meant for, see get_tv_type(), or
+                    BT_TV_ANY */
+  uint8_t pad[3];
+  uint32_t map_offset; /* in the diskmap payload */
+  uint32_t map_size;   /* bytes */
+  uint32_t disk_size;  /* bytes the variant reads as */
+};
+
+#define BT_TV_ANY 0xFF
+
+/* Chunk map, as passed to the kernel: a header and the chunks in disk
+ * order. Chunks start at any byte of the variant, so a sector may span
+ * several, and on at least CDC_ALIGN boundaries in the store. */
+#define CDC_MAP_MAGIC 0x43444D31 /* "CDM1" */
+#define CDC_ALIGN 8
+
+struct cdc_map_hdr {
+  uint32_t magic;
+  uint32_t nchunks;
+  uint32_t disk_size;
+  uint32_t store_size;
+};
+
+struct cdc_chunk {
+  uint32_t disk_offset;
+  uint32_t store_offset; /* from the start of the disk payload */
+  uint32_t size;
+};
+
+/* Payload ids and their names in the packing tools. Append only. */
+#define PAYLOAD_IDS(X)                                                         \
+  X(KERNEL, "kernel")                                                          \
+  X(DISK, "disk")                                                              \
+  X(KERNEL_ALT, "altkernel")                                                   \
+  X(INITRD, "initrd")                                                          \
+  X(DICT, "dict")                                                              \
+  X(CMDLINE, "cmdline")                                                        \
+  X(DISKMAP, "diskmap")                                                        \
+  X(READAHEAD, "readahead")                                                    \
+  X(XIP, "xip")                                                                \
+  X(STAGE1, "stage1")
+
+#define PAYLOAD_ENUM(id, name) PL_##id,
+enum { PL_NONE, PAYLOAD_IDS(PAYLOAD_ENUM) PL_NUM_IDS };
+#undef PAYLOAD_ENUM
+
+#define PL_F_CRITICAL 0x0001 /* read during boot, kept contiguous */
+#define PL_F_MAPPED 0x0002   /* left in the cart for the kernel to map */
+
+/* Mapped payloads start on a page boundary and have the rest of their
+ * last page to themselves, and must lie in the part of the cart the PI
+ * decodes */
+#define PL_MAP_ALIGN 0x1000
+#define PL_MAP_LIMIT 0x0FC00000
+
+/* Cart address of a ROM offset, through the uncached PI window */
+#define ROM_ADDR(off) (0xB0000000 + (off))
+/* and its physical address, for the kernel */
+#define ROM_PHYS(off) (0x10000000 + (off))
+
+#ifdef N64
+int boottab_load(const void *page);
+const void *boottab_find(unsigned tag, unsigned *len);
+const struct bt_payload *payload_find(unsigned id);
+#endif
+
+#endif
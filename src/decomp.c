@@ -0,0 +1,134 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <string.h>
+
+#include "arena.h"
+#include "decomp.h"
+#include "trace.h"
+
+DEFINE_RSP_UCODE(rsp_lzb);
+
+#define LZB_MAX_BLOCKS 4096 /* 8 MB decoded */
+
+// Mirrors PARAMS in rsp_lzb.S
+struct lzb_params {
+  uint32_t in;
+  uint32_t out;
+  uint32_t nblocks;
+  uint32_t last_usize;
+  uint16_t table[LZB_BATCH];
+};
+
+#define STAGE (LZB_BATCH * LZB_BLOCK)
+
+/* Decode the container at cart into dest. While the RSP decodes one batch
+ * of blocks the PI is already fetching the next into the other staging
+ * buffer. room is how much may be written at dest: the RSP stores the
+ * last block rounded up to 8 bytes, and when that does not fit the last
+ * block is decoded on the CPU instead. */
+int lzb_load(uint32_t cart, const struct lzb_hdr *hdr, void *dest,
+             uint32_t room) {
+  const uint32_t n = hdr->nblocks;
+  uint32_t src = cart + LZB_DATA_OFFSET(n);
+  uint32_t i, k, j;
+  int busy = 0;
+
+  if (n > LZB_MAX_BLOCKS || n != (hdr->usize + LZB_BLOCK - 1) / LZB_BLOCK ||
+      hdr->usize > room || ((uint32_t)dest & 7))
+    return -1;
+
+  struct lzb_params *const params = arena_alloc(sizeof(*params));
+  uint16_t *const table = arena_alloc(2 * n + 2);
+  uint8_t *const stage[2] = {arena_alloc(STAGE), arena_alloc(STAGE)};
+
+  data_cache_hit_writeback_invalidate(table, 2 * n);
+  dma_read(table, cart + sizeof(*hdr), (2 * n + 1) & ~1);
+
+  const uint32_t rsp_blocks = LZB_ALIGN8(hdr->usize) > room ? n - 1 : n;
+
+  data_cache_hit_writeback_invalidate(dest, LZB_ALIGN8(hdr->usize));
+  data_cache_hit_writeback_invalidate(stage[0], STAGE);
+  data_cache_hit_writeback_invalidate(stage[1], STAGE);
+
+  rsp_init();
+  rsp_load(&rsp_lzb);
+
+  for (i = 0, k = 0; i < rsp_blocks; k ^= 1) {
+    const uint32_t cnt =
+        rsp_blocks - i < LZB_BATCH ? rsp_blocks - i : LZB_BATCH;
+    uint32_t bytes = 0;
+
+    for (j = 0; j < cnt; j++) {
+      const uint32_t raw = LZB_ALIGN8(LZB_BLOCK_SIZE(hdr->usize, i + j));
+
+      // A coded block has to fit the RSP's input buffer
+      if (table[i + j] > raw ||
+          (table[i + j] > LZB_MAX_CSIZE && table[i + j] != raw))
+        return -1;
+      bytes += table[i + j];
+    }
+
+    trace_dma_begin(TRACE_PI, KERNEL, bytes);
+    dma_read(stage[k], src, bytes);
+    trace_dma_end(TRACE_PI, KERNEL, bytes);
+
+    if (busy) {
+      rsp_wait();
+      trace_dma_end(TRACE_SP, DECOMP, 0);
+    }
+
+    params->in = PhysicalAddr(stage[k]);
+    params->out = PhysicalAddr((uint8_t *)dest + i * LZB_BLOCK);
+    params->nblocks = cnt;
+    params->last_usize = LZB_BLOCK_SIZE(hdr->usize, i + cnt - 1);
+    memcpy(params->table, table + i, 2 * cnt);
+    data_cache_hit_writeback(params, sizeof(*params));
+    rsp_load_data(params, sizeof(*params), 0);
+
+    trace_dma_begin(TRACE_SP, DECOMP, cnt * LZB_BLOCK);
+    rsp_run_async();
+    busy = 1;
+
+    src += bytes;
+    i += cnt;
+  }
+
+  if (busy) {
+    rsp_wait();
+    trace_dma_end(TRACE_SP, DECOMP, 0);
+  }
+
+  if (rsp_blocks < n) {
+    uint8_t *const out = (uint8_t *)dest + (n - 1) * LZB_BLOCK;
+    const uint32_t bsize = LZB_BLOCK_SIZE(hdr->usize, n - 1);
+    const uint32_t csize = table[n - 1];
+
+    if (csize > LZB_ALIGN8(bsize))
+      return -1;
+
+    dma_read(stage[0], src, csize);
+    if (csize == LZB_ALIGN8(bsize))
+      memcpy(out, stage[0], bsize);
+    else if (lzb_decode_block(stage[0], csize, out, bsize))
+      return -1;
+    data_cache_hit_writeback(out, bsize);
+  }
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Development boot client, see devboot.h. Plain C without libdragon, as
+ * util/devserver builds it too. */
+
+#include <string.h>
+
+#include "devboot.h"
+
+static void wr32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static uint32_t rd32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static int request(const struct dev_transport *t, unsigned id, uint32_t offset,
+                   uint32_t len) {
+  uint8_t *const req = t->bounce;
+
+  wr32(req, DEV_REQ_MAGIC);
+  wr32(req + 4, id);
+  wr32(req + 8, offset);
+  wr32(req + 12, len);
+  return t->write(t->ctx, req, sizeof(struct dev_req));
+}
+
+// Header block of the answer; returns the data length or -1
+static int32_t response(const struct dev_transport *t, unsigned id,
+                        uint32_t *size) {
+  const uint8_t *const rsp = t->bounce;
+
+  if (t->read(t->ctx, t->bounce, DEV_BLOCK) || rd32(rsp) != DEV_RSP_MAGIC ||
+      rd32(rsp + 4) != id || rd32(rsp + 12) > DEV_CHUNK)
+    return -1;
+
+  if (size)
+    *size = rd32(rsp + 8);
+  return rd32(rsp + 12);
+}
+
+// Returns 0 when a host answers within DEV_HELLO_TRIES polls
+int dev_hello(const struct dev_transport *t) {
+  unsigned i;
+
+  if (request(t, 0, 0, 0))
+    return -1;
+
+  for (i = 0; i < DEV_HELLO_TRIES; i++)
+    if (t->ready(t->ctx))
+      return response(t, 0, NULL) == 0 ? 0 : -1;
+
+  return -1;
+}
+
+/* Fetch len bytes from offset of payload id straight into dest. Whole
+ * blocks land in place; only a partial last block of each chunk goes
+ * through the bounce buffer. Returns the bytes read, short at the end of
+ * the payload, or -1. size receives the payload size. */
+int dev_read(const struct dev_transport *t, unsigned id, uint32_t offset,
+             void *dest, uint32_t len, uint32_t *size) {
+  uint8_t *out = dest;
+  uint32_t done = 0;
+
+  do {
+    const uint32_t want = len - done < DEV_CHUNK ? len - done : DEV_CHUNK;
+
+    if (request(t, id, offset + done, want))
+      return -1;
+
+    const int32_t got = response(t, id, size);
+    if (got < 0 || (uint32_t)got > want)
+      return -1;
+
+    const uint32_t whole = got & ~(DEV_BLOCK - 1);
+    if (whole && t->read(t->ctx, out, whole))
+      return -1;
+
+    if (got & (DEV_BLOCK - 1)) {
+      if (t->read(t->ctx, t->bounce, DEV_BLOCK))
+        return -1;
+      memcpy(out + whole, t->bounce, got - whole);
+    }
+
+    out += got;
+    done += got;
+    if ((uint32_t)got < want)
+      break;
+  } while (done < len);
+
+  return done;
+}
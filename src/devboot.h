@@ -0,0 +1,80 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Development boot over the flashcart USB port.
+ *
+ * Instead of the cart, a host running util/devserver supplies the kernel
+ * and an optional initrd, so a new kernel boots without packing and
+ * flashing a ROM. The loader asks for byte ranges of a payload by PL_* id
+ * and the host answers each with a 512-byte header block followed by the
+ * data, padded to whole blocks since the cart FIFO moves 512 bytes at a
+ * time. Requests are 16 bytes. Everything is big-endian on the wire.
+ *
+ * The client below only sees a transport, so util/devserver runs the same
+ * code against a simulated link on the host. Shared with the host tools;
+ * keep it plain C. */
+
+#ifndef DEVBOOT_H
+#define DEVBOOT_H
+
+#include <stdint.h>
+
+#define DEV_REQ_MAGIC 0x44565251 /* "DVRQ" */
+#define DEV_RSP_MAGIC 0x44565253 /* "DVRS" */
+
+#define DEV_BLOCK 512
+#define DEV_CHUNK (64 * 1024) /* most bytes asked for at once */
+
+/* Polls of dev_hello() before giving up on the host */
+#define DEV_HELLO_TRIES 300
+
+/* Loader to host. A zero length only asks for the payload size; id
+ * PL_NONE is the hello. */
+struct dev_req {
+  uint32_t magic;
+  uint32_t id;
+  uint32_t offset;
+  uint32_t len;
+};
+
+/* Host to loader, at the start of a block of its own */
+struct dev_rsp {
+  uint32_t magic;
+  uint32_t id;
+  uint32_t size; /* whole payload, 0 if the host has none */
+  uint32_t len;  /* data blocks that follow hold this many bytes */
+};
+
+struct dev_transport {
+  /* Exact transfers; reads are whole blocks. 0 on success. */
+  int (*read)(void *ctx, void *buf, uint32_t len);
+  int (*write)(void *ctx, const void *buf, uint32_t len);
+  /* Nonzero once data is waiting, may wait a little first */
+  int (*ready)(void *ctx);
+  void *ctx;
+  uint8_t *bounce; /* DEV_BLOCK bytes, 8-byte aligned */
+};
+
+int dev_hello(const struct dev_transport *t);
+int dev_read(const struct dev_transport *t, unsigned id, uint32_t offset,
+             void *dest, uint32_t len, uint32_t *size);
+
+#ifdef N64
+const struct dev_transport *devusb_open(void);
+#endif
+
+#endif
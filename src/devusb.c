@@ -0,0 +1,134 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* EverDrive-64 (V3, X7) USB FIFO as a development boot transport.
+ *
+ * The cart exposes a 512-byte USB buffer and a control register behind
+ * its register window. A transfer of n bytes uses the last n bytes of the
+ * buffer: start it with the buffer offset in the control register, wait
+ * for the busy bit to drop, and move the data with PI DMA. This is the
+ * scheme UNFLoader uses. */
+
+#include <libdragon.h>
+
+#include "arena.h"
+#include "devboot.h"
+
+#define ED_REGS 0x1F800000
+#define ED_REG_USBCFG 0x0004
+#define ED_REG_VERSION 0x0014
+#define ED_REG_USBDAT 0x0400
+#define ED_REG_KEY 0x8004
+
+#define ED_KEY 0xAA55
+
+#define ED_USB_RD_NOP 0xC400
+#define ED_USB_RD 0xC600
+#define ED_USB_WR_NOP 0xC000
+#define ED_USB_WR 0xC200
+
+#define ED_USB_ACT 0x0200
+#define ED_USB_RXF 0x0400 /* set while there is nothing to read */
+#define ED_USB_PWR 0x1000
+
+#define ED_BUSY_POLLS 100000
+
+static int usb_wait(void) {
+  unsigned i;
+
+  for (i = 0; i < ED_BUSY_POLLS; i++)
+    if (!(io_read(ED_REGS + ED_REG_USBCFG) & ED_USB_ACT))
+      return 0;
+
+  return -1;
+}
+
+static int usb_read(void *ctx, void *buf, uint32_t len) {
+  uint8_t *p = buf;
+  (void)ctx;
+
+  data_cache_hit_writeback_invalidate(buf, len);
+
+  while (len) {
+    const uint32_t n = len < DEV_BLOCK ? len : DEV_BLOCK;
+    const uint32_t at = DEV_BLOCK - n;
+
+    // Wait for the host, then pull the block into the FIFO buffer
+    while (io_read(ED_REGS + ED_REG_USBCFG) & ED_USB_RXF)
+      ;
+    io_write(ED_REGS + ED_REG_USBCFG, ED_USB_RD | at);
+    if (usb_wait())
+      return -1;
+    io_write(ED_REGS + ED_REG_USBCFG, ED_USB_RD_NOP);
+
+    dma_read(p, 0xA0000000 | (ED_REGS + ED_REG_USBDAT + at), n);
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int usb_write(void *ctx, const void *buf, uint32_t len) {
+  const uint8_t *p = buf;
+  (void)ctx;
+
+  data_cache_hit_writeback(buf, len);
+  io_write(ED_REGS + ED_REG_USBCFG, ED_USB_WR_NOP);
+
+  while (len) {
+    const uint32_t n = len < DEV_BLOCK ? len : DEV_BLOCK;
+    const uint32_t at = DEV_BLOCK - n;
+
+    dma_write(p, 0xA0000000 | (ED_REGS + ED_REG_USBDAT + at), n);
+    io_write(ED_REGS + ED_REG_USBCFG, ED_USB_WR | at);
+    if (usb_wait())
+      return -1;
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int usb_ready(void *ctx) {
+  (void)ctx;
+
+  const uint32_t cfg = io_read(ED_REGS + ED_REG_USBCFG);
+  if ((cfg & (ED_USB_PWR | ED_USB_RXF)) == ED_USB_PWR)
+    return 1;
+
+  wait_ms(1);
+  return 0;
+}
+
+static struct dev_transport usb = {usb_read, usb_write, usb_ready, NULL,
+                                   NULL};
+
+// NULL unless an EverDrive with USB power is present
+const struct dev_transport *devusb_open(void) {
+  io_write(ED_REGS + ED_REG_KEY, ED_KEY);
+
+  const uint32_t version = io_read(ED_REGS + ED_REG_VERSION) & 0xFFFF;
+  if (!version || version == 0xFFFF)
+    return NULL;
+  if (!(io_read(ED_REGS + ED_REG_USBCFG) & ED_USB_PWR))
+    return NULL;
+
+  usb.bounce = arena_alloc(DEV_BLOCK);
+  return &usb;
+}
@@ -0,0 +1,85 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* The ELF32 headers the loaders read, as in glibc's elf.h, which
+ * newlib does not have */
+
+#ifndef ELF32_H
+#define ELF32_H
+
+#include <stdint.h>
+
+/* Type for a 16-bit quantity.  */
+typedef uint16_t Elf32_Half;
+
+/* Types for signed and unsigned 32-bit quantities.  */
+typedef uint32_t Elf32_Word;
+typedef int32_t Elf32_Sword;
+
+/* Types for signed and unsigned 64-bit quantities.  */
+typedef uint64_t Elf32_Xword;
+typedef int64_t Elf32_Sxword;
+
+/* Type of addresses.  */
+typedef uint32_t Elf32_Addr;
+
+/* Type of file offsets.  */
+typedef uint32_t Elf32_Off;
+
+/* Type for section indices, which are 16-bit quantities.  */
+typedef uint16_t Elf32_Section;
+
+/* Type for version symbol information.  */
+typedef Elf32_Half Elf32_Versym;
+
+#define EI_NIDENT (16)
+
+#define EI_CLASS 4     /* File class byte index */
+#define ELFCLASSNONE 0 /* Invalid class */
+#define ELFCLASS32 1   /* 32-bit objects */
+#define ELFCLASS64 2   /* 64-bit objects */
+#define ELFCLASSNUM 3
+
+typedef struct {
+  unsigned char e_ident[EI_NIDENT]; /* Magic number and other info */
+  Elf32_Half e_type;                /* Object file type */
+  Elf32_Half e_machine;             /* Architecture */
+  Elf32_Word e_version;             /* Object file version */
+  Elf32_Addr e_entry;               /* Entry point virtual address */
+  Elf32_Off e_phoff;                /* Program header table file offset */
+  Elf32_Off e_shoff;                /* Section header table file offset */
+  Elf32_Word e_flags;               /* Processor-specific flags */
+  Elf32_Half e_ehsize;              /* ELF header size in bytes */
+  Elf32_Half e_phentsize;           /* Program header table entry size */
+  Elf32_Half e_phnum;               /* Program header table entry count */
+  Elf32_Half e_shentsize;           /* Section header table entry size */
+  Elf32_Half e_shnum;               /* Section header table entry count */
+  Elf32_Half e_shstrndx;            /* Section header string table index */
+} Elf32_Ehdr;
+
+typedef struct {
+  Elf32_Word p_type;   /* Segment type */
+  Elf32_Off p_offset;  /* Segment file offset */
+  Elf32_Addr p_vaddr;  /* Segment virtual address */
+  Elf32_Addr p_paddr;  /* Segment physical address */
+  Elf32_Word p_filesz; /* Segment size in file */
+  Elf32_Word p_memsz;  /* Segment size in memory */
+  Elf32_Word p_flags;  /* Segment flags */
+  Elf32_Word p_align;  /* Segment alignment */
+} Elf32_Phdr;
+
+#endif
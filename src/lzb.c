@@ -0,0 +1,159 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Reference LZB decoder. Plain C and bounds-checked, so the same file is
+ * the CPU fallback in the loader and the bit-exact reference the host
+ * tools check the RSP model against. */
+
+#include <string.h>
+
+#include "lzb.h"
+
+static uint32_t rd32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* Returns 0 once exactly outlen bytes were produced, -1 on corrupt input.
+ * Matches may reach back into the dictionary, if any, as if it came right
+ * before out. */
+int lzb_decode_block_dict(const uint8_t *in, unsigned inlen, uint8_t *out,
+                          unsigned outlen, const uint8_t *dict,
+                          unsigned dictlen) {
+  const uint8_t *ip = in, *const iend = in + inlen;
+  uint8_t *op = out, *const oend = out + outlen;
+  unsigned b;
+
+  while (1) {
+    if (ip >= iend)
+      return -1;
+
+    const unsigned token = *ip++;
+    unsigned lit = token >> 4, len = token & 15;
+
+    if (lit == 15) {
+      do {
+        if (ip >= iend)
+          return -1;
+        b = *ip++;
+        lit += b;
+      } while (b == 255);
+    }
+
+    if (lit > (unsigned)(iend - ip) || lit > (unsigned)(oend - op))
+      return -1;
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+
+    if (op == oend)
+      return 0;
+
+    if (iend - ip < 2)
+      return -1;
+    const unsigned off = ip[0] << 8 | ip[1];
+    ip += 2;
+
+    if (len == 15) {
+      do {
+        if (ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+    len += LZB_MIN_MATCH;
+
+    const unsigned back = op - out;
+    if (!off || off > back + dictlen || len > (unsigned)(oend - op))
+      return -1;
+
+    if (off > back) {
+      const unsigned n = off - back < len ? off - back : len;
+
+      memcpy(op, dict + dictlen - (off - back), n);
+      op += n;
+      len -= n;
+    }
+    while (len--) {
+      *op = *(op - off);
+      op++;
+    }
+
+    if (op == oend)
+      return 0;
+  }
+}
+
+int lzb_decode_block(const uint8_t *in, unsigned inlen, uint8_t *out,
+                     unsigned outlen) {
+  return lzb_decode_block_dict(in, inlen, out, outlen, NULL, 0);
+}
+
+// FNV-1a over the dictionary, which coded containers name it by
+uint32_t lzb_dict_id(const uint8_t *dict, size_t len) {
+  uint32_t h = 2166136261u;
+
+  while (len--)
+    h = (h ^ *dict++) * 16777619u;
+  return h;
+}
+
+/* Decode a whole container into out, which must hold its usize bytes.
+ * Without a dictionary only plain containers are accepted, with one only
+ * those coded against it. */
+int lzb_decode_dict(const uint8_t *in, size_t inlen, uint8_t *out,
+                    size_t outlen, const uint8_t *dict, size_t dictlen) {
+  uint32_t i;
+
+  if (inlen < sizeof(struct lzb_hdr) || dictlen > LZB_DICT_MAX)
+    return -1;
+  if (dict ? rd32(in) != LZB_DICT_MAGIC ||
+                 rd32(in + 12) != lzb_dict_id(dict, dictlen)
+           : rd32(in) != LZB_MAGIC)
+    return -1;
+
+  const uint32_t usize = rd32(in + 4);
+  const uint32_t nblocks = rd32(in + 8);
+  if (usize > outlen || nblocks != (usize + LZB_BLOCK - 1) / LZB_BLOCK ||
+      LZB_DATA_OFFSET(nblocks) > inlen)
+    return -1;
+
+  size_t pos = LZB_DATA_OFFSET(nblocks);
+  for (i = 0; i < nblocks; i++) {
+    const uint8_t *const t = in + sizeof(struct lzb_hdr) + 2 * i;
+    const unsigned csize = t[0] << 8 | t[1];
+    const unsigned bsize = LZB_BLOCK_SIZE(usize, i);
+
+    if (csize > inlen - pos)
+      return -1;
+
+    if (csize == LZB_ALIGN8(bsize))
+      memcpy(out + (size_t)i * LZB_BLOCK, in + pos, bsize);
+    else if (lzb_decode_block_dict(in + pos, csize,
+                                   out + (size_t)i * LZB_BLOCK, bsize, dict,
+                                   dictlen))
+      return -1;
+
+    pos += csize;
+  }
+
+  return 0;
+}
+
+int lzb_decode(const uint8_t *in, size_t inlen, uint8_t *out, size_t outlen) {
+  return lzb_decode_dict(in, inlen, out, outlen, NULL, 0);
+}
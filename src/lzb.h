@@ -0,0 +1,95 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* LZB, the block LZ format used for compressed payloads.
+ *
+ * The payload is cut into independent 2 KB blocks so that one block and
+ * its compressed input both fit in RSP DMEM. A block is a series of
+ * LZ4-style sequences: a token byte holding the literal count in the high
+ * nibble and the match length minus 4 in the low one (15 means more
+ * length bytes follow, added until one is not 255), the literals, then a
+ * big-endian 16-bit match offset and the match. A block ends as soon as
+ * its output is complete, after either the literals or the match.
+ *
+ * Each compressed block is padded to 8 bytes for SP DMA. Blocks that do
+ * not shrink below LZB_MAX_CSIZE are stored raw, which the decoder tells
+ * apart by their size being the block size rounded up to 8.
+ *
+ * Container layout, big-endian: struct lzb_hdr, a 16-bit stored size per
+ * block padded to 8 bytes, then the blocks back to back. Shared with the
+ * host tools.
+ *
+ * Small payloads barely compress on their own, so they can instead be
+ * coded against a shared dictionary stored once in the ROM. Such
+ * containers have the LZB_DICT_MAGIC and every block decodes as if the
+ * dictionary came right before it, so match offsets may reach past the
+ * block start into its tail. The load field holds the dictionary id.
+ * These are decoded on the CPU only. */
+
+#ifndef LZB_H
+#define LZB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZB_MAGIC 0x4C5A4231      /* "LZB1" */
+#define LZB_DICT_MAGIC 0x4C5A4431 /* "LZD1" */
+#define LZB_BLOCK 2048
+#define LZB_MIN_MATCH 4
+
+/* Largest dictionary, so that offsets from the end of a block still fit
+ * in 16 bits */
+#define LZB_DICT_MAX (32 * 1024)
+
+/* Room left for compressed input in DMEM, see rsp_lzb.S */
+#define LZB_MAX_CSIZE 1872
+
+/* Blocks handed to the RSP per run, limited by the table in DMEM */
+#define LZB_BATCH 16
+
+struct lzb_hdr {
+  uint32_t magic;
+  uint32_t usize;   /* uncompressed bytes */
+  uint32_t nblocks; /* usize / LZB_BLOCK rounded up */
+  uint32_t load;    /* kernels: physical load address, else 0 */
+  uint32_t entry;   /* kernels: entry point */
+  uint32_t memsz;   /* kernels: size in memory including bss */
+};
+
+#define LZB_ALIGN8(x) (((x) + 7) & ~7)
+
+/* Offset of the first block from the start of the container */
+#define LZB_DATA_OFFSET(nblocks)                                               \
+  LZB_ALIGN8(sizeof(struct lzb_hdr) + 2 * (nblocks))
+
+/* Decoded size of block i */
+#define LZB_BLOCK_SIZE(usize, i)                                               \
+  ((usize) - (i) * LZB_BLOCK < LZB_BLOCK ? (usize) - (i) * LZB_BLOCK           \
+                                         : LZB_BLOCK)
+
+int lzb_decode_block(const uint8_t *in, unsigned inlen, uint8_t *out,
+                     unsigned outlen);
+int lzb_decode(const uint8_t *in, size_t inlen, uint8_t *out, size_t outlen);
+
+uint32_t lzb_dict_id(const uint8_t *dict, size_t len);
+int lzb_decode_block_dict(const uint8_t *in, unsigned inlen, uint8_t *out,
+                          unsigned outlen, const uint8_t *dict,
+                          unsigned dictlen);
+int lzb_decode_dict(const uint8_t *in, size_t inlen, uint8_t *out,
+                    size_t outlen, const uint8_t *dict, size_t dictlen);
+
+#endif
@@ -17,9 +17,23 @@
 
 #include <libdragon.h>
 #include <malloc.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "boottab.h"
+#include "decomp.h"
+#include "devboot.h"
+#include "elf32.h"
+#include "lzb.h"
+#include "memmap.h"
+#include "pidma.h"
+#include "resident.h"
+#include "telemetry.h"
+#include "trace.h"
 
 typedef uint64_t u64;
 typedef unsigned int u32;
@@ -31,97 +45,393 @@ typedef signed int s32;
 typedef int16_t s16;
 typedef int8_t s8;
 
-/* Type for a 16-bit quantity.  */
-typedef uint16_t Elf32_Half;
-
-/* Types for signed and unsigned 32-bit quantities.  */
-typedef uint32_t Elf32_Word;
-typedef int32_t Elf32_Sword;
-
-/* Types for signed and unsigned 64-bit quantities.  */
-typedef uint64_t Elf32_Xword;
-typedef int64_t Elf32_Sxword;
-
-/* Type of addresses.  */
-typedef uint32_t Elf32_Addr;
-
-/* Type of file offsets.  */
-typedef uint32_t Elf32_Off;
-
-/* Type for section indices, which are 16-bit quantities.  */
-typedef uint16_t Elf32_Section;
-
-/* Type for version symbol information.  */
-typedef Elf32_Half Elf32_Versym;
-
-#define EI_NIDENT (16)
-
-#define EI_CLASS 4     /* File class byte index */
-#define ELFCLASSNONE 0 /* Invalid class */
-#define ELFCLASS32 1   /* 32-bit objects */
-#define ELFCLASS64 2   /* 64-bit objects */
-#define ELFCLASSNUM 3
-
-typedef struct {
-  unsigned char e_ident[EI_NIDENT]; /* Magic number and other info */
-  Elf32_Half e_type;                /* Object file type */
-  Elf32_Half e_machine;             /* Architecture */
-  Elf32_Word e_version;             /* Object file version */
-  Elf32_Addr e_entry;               /* Entry point virtual address */
-  Elf32_Off e_phoff;                /* Program header table file offset */
-  Elf32_Off e_shoff;                /* Section header table file offset */
-  Elf32_Word e_flags;               /* Processor-specific flags */
-  Elf32_Half e_ehsize;              /* ELF header size in bytes */
-  Elf32_Half e_phentsize;           /* Program header table entry size */
-  Elf32_Half e_phnum;               /* Program header table entry count */
-  Elf32_Half e_shentsize;           /* Section header table entry size */
-  Elf32_Half e_shnum;               /* Section header table entry count */
-  Elf32_Half e_shstrndx;            /* Section header string table index */
-} Elf32_Ehdr;
-
-typedef struct {
-  Elf32_Word p_type;   /* Segment type */
-  Elf32_Off p_offset;  /* Segment file offset */
-  Elf32_Addr p_vaddr;  /* Segment virtual address */
-  Elf32_Addr p_paddr;  /* Segment physical address */
-  Elf32_Word p_filesz; /* Segment size in file */
-  Elf32_Word p_memsz;  /* Segment size in memory */
-  Elf32_Word p_flags;  /* Segment flags */
-  Elf32_Word p_align;  /* Segment alignment */
-} Elf32_Phdr;
-
 extern int __bootcic;
+extern char end[]; /* end of the loader image, where the heap starts */
+
+#define MAX_ARGS RS_MAX_ARGS
+
+static const char *args[MAX_ARGS + 1] = {"hello"};
+static int nargs = 1;
+
+// The resident block keeps argv[0] in its copy of this too
+static char argbuf[RS_ARGBUF - sizeof("hello")];
+static unsigned argpos;
+
+static u32 kernelsize;
+static u32 disksize;
+static u32 diskoff;
+
+// Cart addresses of the kernel ELF and the disk
+static u32 kernel_addr = 0xB0101000;
+static u32 disk_addr;
+
+static int verify;
+
+/* Read at the top of main() while the CPU sets up: the boot table page,
+ * which ends in the size words, and the head of the kernel behind it */
+#define EARLY_KERNEL (28 * 1024)
+static u8 early[0x1000 + EARLY_KERNEL] __attribute__((aligned(16)));
+
+// Cart address of the kernel head in early, once it is there
+static u32 early_at;
+
+#ifdef DEVBOOT
+// Set when a USB host supplies the kernel, see devboot.h
+static const struct dev_transport *dev;
+#endif
+
+// Append one kernel argument, formatted into argbuf
+static void add_arg(const char *fmt, ...) {
+  char head[40];
+  va_list ap;
+  int len = -1;
+
+  if (nargs < MAX_ARGS && argpos < sizeof(argbuf)) {
+    va_start(ap, fmt);
+    len = vsnprintf(argbuf + argpos, sizeof(argbuf) - argpos, fmt, ap);
+    va_end(ap);
+  }
+
+  if (len < 0 || argpos + len >= sizeof(argbuf)) {
+    va_start(ap, fmt);
+    vsnprintf(head, sizeof(head), fmt, ap);
+    va_end(ap);
+    printf("No room for kernel argument %s\n", head);
+    return;
+  }
+
+  args[nargs++] = argbuf + argpos;
+  argpos += len + 1;
+}
+
+static char *hex(char *out, const u8 *in, unsigned len) {
+  static const char digits[] = "0123456789abcdef";
+  unsigned i;
+
+  for (i = 0; i < len; i++) {
+    out[i * 2] = digits[in[i] >> 4];
+    out[i * 2 + 1] = digits[in[i] & 15];
+  }
+  out[len * 2] = 0;
+  return out;
+}
+
+// Read part of the kernel payload, from the cart or the USB host
+static void kernel_read(void *dest, u32 offset, u32 len) {
+#ifdef DEVBOOT
+  if (dev) {
+    if (dev_read(dev, PL_KERNEL, offset, dest, len, NULL) != (int)len) {
+      printf("USB transfer failed, halting...\n");
+
+      while (1)
+        ;
+    }
+    return;
+  }
+#endif
+  pi_dma_wait();
+
+  // Take what the early read brought in, the rest from the cart
+  if (early_at == kernel_addr && offset < EARLY_KERNEL && !(offset & 7)) {
+    const u32 n = len < EARLY_KERNEL - offset ? len : EARLY_KERNEL - offset;
+    memcpy(dest, early + 0x1000 + offset, n);
+    data_cache_hit_writeback(dest, n);
+    dest = (u8 *)dest + n;
+    offset += n;
+    len -= n;
+    if (!len)
+      return;
+  }
+  dma_read(dest, kernel_addr + offset, (len + 1) & ~1);
+}
+
+#ifdef DEVBOOT
+// Place the host's initrd, if any, on the next page after the kernel
+static void initrd_args(u32 end) {
+  const u32 at = (end + 4095) & ~4095;
+  u32 size = 0;
+
+  if (dev_read(dev, PL_INITRD, 0, NULL, 0, &size) || !size)
+    return;
+
+  if (arena_claim(at, size)) {
+    printf("No room for the initrd\n");
+    return;
+  }
+
+  trace_dma_begin(TRACE_PI, DEVUSB, size);
+  const int got = dev_read(dev, PL_INITRD, 0, (void *)at, size, NULL);
+  trace_dma_end(TRACE_PI, DEVUSB, size);
+  if (got != (int)size) {
+    printf("USB transfer failed, no initrd\n");
+    return;
+  }
+
+  memmap_add(at, size, "initrd", MM_KERNEL);
+  add_arg("rd_start=0x%08lx", (unsigned long)at);
+  add_arg("rd_size=%lu", (unsigned long)size);
+}
+#endif
+
+// Read a small payload from the cart into a new buffer
+static u8 *payload_read(const struct bt_payload *pl) {
+  u8 *const p = arena_alloc(LZB_ALIGN8(pl->size));
+
+  data_cache_hit_writeback_invalidate(p, pl->size);
+  dma_read(p, ROM_ADDR(pl->offset), (pl->size + 1) & ~1);
+  return p;
+}
+
+/* Small payloads may be coded against the dictionary stored once in the
+ * ROM, see lzb.h. Returns the payload as the kernel wants it, or NULL. */
+static const u8 *small_payload(unsigned id, u32 *len) {
+  static const u8 *dict;
+  static u32 dictlen;
+
+  const struct bt_payload *const pl = payload_find(id);
+  if (!pl)
+    return NULL;
+
+  const u8 *const p = payload_read(pl);
+  const struct lzb_hdr *const lz = (const struct lzb_hdr *)p;
+  if (pl->size < sizeof(*lz) || lz->magic != LZB_DICT_MAGIC) {
+    *len = pl->size;
+    return p;
+  }
+
+  if (!dict) {
+    const struct bt_payload *const dpl = payload_find(PL_DICT);
+    if (!dpl || dpl->size > LZB_DICT_MAX) {
+      printf("No dictionary for payload %u\n", id);
+      return NULL;
+    }
+    dict = payload_read(dpl);
+    dictlen = dpl->size;
+  }
+
+  u8 *const out = arena_alloc(lz->usize);
+  if (lzb_decode_dict(p, pl->size, out, lz->usize, dict, dictlen)) {
+    printf("Corrupt payload %u\n", id);
+    return NULL;
+  }
+
+  *len = lz->usize;
+  return out;
+}
+
+// Extra kernel arguments from the ROM, split on white space outside quotes
+static void cmdline_args(const char *p, u32 len) {
+  const char *const end = p + len;
+  while (p < end) {
+    const char *const word = p;
+    int quoted = 0;
+
+    while (p < end && (quoted || (*p != ' ' && *p != '\t' && *p != '\n' &&
+                                  *p != '\r' && *p))) {
+      if (*p == '"')
+        quoted = !quoted;
+      p++;
+    }
+
+    if (p > word)
+      add_arg("%.*s", (int)(p - word), word);
+    else
+      p++;
+  }
+}
 
-static u8 hdrbuf[256] __attribute__((aligned(16)));
+/* With several disk variants in one chunk store, pass the chunk map of
+ * the one meant for this console's TV type, else the first */
+static void variant_args(void) {
+  unsigned len, i;
 
-static const char *const args[] = {"hello", (const char *)hdrbuf,
-                                   (const char *)hdrbuf + 128,
-                                   "root=/dev/n64cart"};
+  const struct bt_variant *const v = boottab_find(BT_VARIANTS, &len);
+  const struct bt_payload *const mpl = payload_find(PL_DISKMAP);
+  if (!v || !mpl || len < sizeof(*v))
+    return;
 
-static char buf[64];
+  const struct bt_variant *pick = v;
+  const unsigned tv = get_tv_type();
+  for (i = len / sizeof(*v); i--;)
+    if (v[i].tv == tv || (v[i].tv == BT_TV_ANY && pick->tv != tv))
+      pick = &v[i];
 
-static u32 kernelsize __attribute__((aligned(8)));
-static u32 disksize __attribute__((aligned(8)));
-static u32 diskoff __attribute__((aligned(8)));
+  printf("Disk variant: %.16s, %lu kb\n", pick->name,
+         (unsigned long)pick->disk_size / 1024);
+
+  add_arg("n64cart.map=%lu",
+          (unsigned long)ROM_ADDR(mpl->offset + pick->map_offset));
+  add_arg("n64cart.mapsize=%lu", (unsigned long)pick->map_size);
+}
+
+/* Where the read-ahead hints for the block driver are, see
+ * util/readahead.h */
+static void readahead_args(void) {
+  const struct bt_payload *const pl = payload_find(PL_READAHEAD);
+  if (!pl)
+    return;
+
+  add_arg("n64cart.readahead=%lu", (unsigned long)ROM_ADDR(pl->offset));
+  add_arg("n64cart.readaheadsize=%lu", (unsigned long)pl->size);
+}
+
+/* Payloads the kernel uses in place, such as an XIP filesystem, are
+ * neither read nor given RAM; it gets their physical cart range */
+static void mapped_args(void) {
+#define PAYLOAD_NAME(id, name) name,
+  static const char *const names[] = {PAYLOAD_IDS(PAYLOAD_NAME)};
+#undef PAYLOAD_NAME
+  unsigned len, i;
+
+  const struct bt_payload *const pl = boottab_find(BT_LAYOUT, &len);
+  if (!pl)
+    return;
+
+  for (i = 0; i < len / sizeof(*pl); i++) {
+    if (!(pl[i].flags & PL_F_MAPPED) || !pl[i].id || pl[i].id >= PL_NUM_IDS)
+      continue;
+    printf("Mapped %s: %lu kb at 0x%08lx\n", names[pl[i].id - 1],
+           (unsigned long)pl[i].size / 1024,
+           (unsigned long)ROM_PHYS(pl[i].offset));
+    add_arg("n64cart.%s=0x%08lx,%lu", names[pl[i].id - 1],
+            (unsigned long)ROM_PHYS(pl[i].offset), (unsigned long)pl[i].size);
+  }
+}
+
+/* Map the disk through dm-verity. The hash tree sits in the same n64cart
+ * device behind the data, so blocks are checked as the kernel reads them
+ * instead of all at once here. */
+static int verity_args(void) {
+  char root[65], salt[65];
+  unsigned len;
+
+  const struct bt_verity *const v = boottab_find(BT_VERITY, &len);
+  if (!v || len < sizeof(*v) || v->salt_len > sizeof(v->salt))
+    return 0;
+
+  add_arg("dm-mod.waitfor=/dev/n64cart");
+  add_arg("dm-mod.create=\"vroot,,,ro,0 %lu verity 1 /dev/n64cart "
+          "/dev/n64cart %u %u %lu %lu sha256 %s %s\"",
+          (unsigned long)v->data_blocks * (v->block_size / 512),
+          v->block_size, v->block_size, (unsigned long)v->data_blocks,
+          (unsigned long)v->hash_start, hex(root, v->root, sizeof(v->root)),
+          v->salt_len ? hex(salt, v->salt, v->salt_len) : "-");
+
+  return 1;
+}
+
+// The kernel image must not land on any staging buffer
+static void claim_kernel(u32 paddr, u32 memsz) {
+  if (arena_claim(paddr, memsz)) {
+    printf("Kernel overlaps loader buffers, halting...\n");
+
+    while (1)
+      ;
+  }
+
+  // The loader image, and its heap with the console framebuffers
+  if (PhysicalAddr(paddr) < PhysicalAddr(sbrk(0)) &&
+      PhysicalAddr(paddr) + memsz > MM_LOADER_BASE) {
+    printf("Kernel overlaps the loader or its heap, halting...\n");
+
+    while (1)
+      ;
+  }
+
+  printf("Staging: %lu kb used, %lu kb free\n",
+         (unsigned long)arena_used() / 1024, (unsigned long)arena_free() / 1024);
+}
 
 /* main code entry point */
 int main(void) {
 
+  trace_begin(BOOT);
+
+  // The cart would sit idle through the setup below
+  pi_dma_start(early, BOOTTAB_ADDR, sizeof(early), TRACE_EARLY);
+
+#ifdef TRACE_LOG
+  debug_init_isviewer();
+  debug_init_usblog();
+#endif
+
+  trace_begin(RAMSIZE);
   const int osMemSize =
       (__bootcic != 6105) ? (*(int *)0xA0000318) : (*(int *)0xA00003F0);
+  trace_end(RAMSIZE);
 
+  trace_begin(CONSOLE);
   console_init();
+  trace_end(CONSOLE);
+
+  // Everything staged from here on comes out of the arena
+  arena_init(osMemSize);
+  resident_init();
+  char *const buf = arena_alloc(64);
+  u8 *const hdrbuf = arena_alloc(256);
 
   sprintf(buf, "Found %u kb of RAM\n", osMemSize / 1024);
   printf(buf);
 
-  data_cache_hit_writeback_invalidate(&kernelsize, 4);
-  dma_read(&kernelsize, 0xB0101000 - 4, 4);
+  trace_begin(EARLYWAIT);
+  pi_dma_wait();
+  trace_end(EARLYWAIT);
+
+  kernelsize = *(u32 *)(early + 0xFFC);
+  disksize = *(u32 *)(early + 0xFF8);
+  early_at = kernel_addr;
 
-  data_cache_hit_writeback_invalidate(&disksize, 4);
-  dma_read(&disksize, 0xB0101000 - 8, 4);
+  trace_begin(BOOTTAB);
+  if (boottab_load(early))
+    printf("No boot table\n");
+  trace_end(BOOTTAB);
 
   diskoff = ((kernelsize + 4095) & ~4095);
+  disk_addr = kernel_addr + diskoff;
+
+  // A packed layout overrides the fixed one
+  const struct bt_payload *const kpl = payload_find(PL_KERNEL);
+  const struct bt_payload *const dpl = payload_find(PL_DISK);
+  if (kpl) {
+    kernel_addr = ROM_ADDR(kpl->offset);
+    kernelsize = kpl->size;
+  }
+  if (dpl) {
+    disk_addr = ROM_ADDR(dpl->offset);
+    disksize = dpl->size;
+  }
+
+  // Kernels the resident stub can switch to later
+  resident_add(PL_KERNEL, kernel_addr, kernelsize);
+  const struct bt_payload *const apl = payload_find(PL_KERNEL_ALT);
+  if (apl)
+    resident_add(PL_KERNEL_ALT, ROM_ADDR(apl->offset), apl->size);
+
+#ifdef DEVBOOT
+  // A host answering on the flashcart USB port overrides the cart kernel
+  trace_begin(DEVUSB);
+  u32 devsize = 0;
+  dev = devusb_open();
+  if (dev && !dev_hello(dev) &&
+      !dev_read(dev, PL_KERNEL, 0, NULL, 0, &devsize) && devsize) {
+    printf("Kernel from the USB host\n");
+    kernelsize = devsize;
+  } else {
+    dev = NULL;
+  }
+  trace_end(DEVUSB);
+#endif
+
+  // A layout may have moved the kernel; fetch its head while printing
+  int refetch = kernel_addr != early_at && kernelsize;
+#ifdef DEVBOOT
+  refetch = refetch && !dev;
+#endif
+  if (refetch) {
+    pi_dma_start(early + 0x1000, kernel_addr, EARLY_KERNEL, TRACE_EARLY);
+    early_at = kernel_addr;
+  }
+
   if (!kernelsize) {
     printf("No kernel configured, halting...\n");
 
@@ -137,67 +447,166 @@ int main(void) {
   sprintf(buf, "Address: %p\n", ptr);
   printf(buf);
 
-  dma_read(ptr, 0xB0101000, 256);
+  trace_begin(ELFHDR);
+  trace_dma_begin(TRACE_PI, ELFHDR, 256);
+  kernel_read(ptr, 0, 256);
+  trace_dma_end(TRACE_PI, ELFHDR, 256);
   data_cache_hit_invalidate(ptr, 256);
-
-  if (ptr->e_ident[1] != 'E' || ptr->e_ident[2] != 'L' ||
-      ptr->e_ident[3] != 'F')
-    printf("Not an ELF kernel?\n");
-
-  if (ptr->e_ident[EI_CLASS] != ELFCLASS32)
-    printf("Not a 32-bit kernel?\n");
-
-  // Where is it wanted?
-  const Elf32_Phdr *phdr = (Elf32_Phdr *)(hdrbuf + ptr->e_phoff);
-  while (phdr->p_type != 1)
-    phdr++;
-
-  sprintf(buf, "LoadAddress: %p\n", (void *)phdr->p_paddr);
-  printf(buf);
-
-  sprintf(buf, "LoadOffset: %p\n", (void *)0xB0101000 + phdr->p_offset);
-  printf(buf);
-
-  // Put it there
-  dma_read((void *)phdr->p_paddr, 0xB0101000 + phdr->p_offset,
-           (phdr->p_filesz + 1) & ~1);
-  data_cache_hit_writeback_invalidate((void *)phdr->p_paddr,
-                                      (phdr->p_filesz + 3) & ~3);
+  trace_end(ELFHDR);
+
+  u32 paddr, filesz, memsz, entry;
+
+  if (*(u32 *)hdrbuf == LZB_MAGIC) {
+    // Compressed kernel, the LZB header carries what the ELF one would
+    const struct lzb_hdr *const lz = (struct lzb_hdr *)hdrbuf;
+#ifdef DEVBOOT
+    if (dev) {
+      printf("Compressed kernels can't come over USB, halting...\n");
+
+      while (1)
+        ;
+    }
+#endif
+    paddr = lz->load;
+    filesz = lz->usize;
+    memsz = lz->memsz;
+    entry = lz->entry;
+
+    sprintf(buf, "LoadAddress: %p\n", (void *)paddr);
+    printf(buf);
+
+    claim_kernel(paddr, memsz);
+
+    trace_begin(KERNEL);
+    if (lzb_load(kernel_addr, lz, (void *)paddr, memsz)) {
+      printf("Corrupt compressed kernel, halting...\n");
+
+      while (1)
+        ;
+    }
+    trace_end(KERNEL);
+  } else {
+    if (ptr->e_ident[1] != 'E' || ptr->e_ident[2] != 'L' ||
+        ptr->e_ident[3] != 'F') {
+      printf("Not an ELF kernel?\n");
+      verify |= TELEM_V_NOELF;
+    }
+
+    if (ptr->e_ident[EI_CLASS] != ELFCLASS32) {
+      printf("Not a 32-bit kernel?\n");
+      verify |= TELEM_V_NOT32;
+    }
+
+    // Where is it wanted?
+    const Elf32_Phdr *phdr = (Elf32_Phdr *)(hdrbuf + ptr->e_phoff);
+    while (phdr->p_type != 1)
+      phdr++;
+
+    paddr = phdr->p_paddr;
+    filesz = phdr->p_filesz;
+    memsz = phdr->p_memsz;
+    entry = ptr->e_entry;
+
+    sprintf(buf, "LoadAddress: %p\n", (void *)paddr);
+    printf(buf);
+
+    sprintf(buf, "LoadOffset: %p\n", (void *)kernel_addr + phdr->p_offset);
+    printf(buf);
+
+    claim_kernel(paddr, memsz);
+
+    // Put it there
+    trace_begin(KERNEL);
+    trace_dma_begin(TRACE_PI, KERNEL, filesz);
+    kernel_read((void *)paddr, phdr->p_offset, filesz);
+    trace_dma_end(TRACE_PI, KERNEL, filesz);
+    data_cache_hit_writeback_invalidate((void *)paddr, (filesz + 3) & ~3);
+    trace_end(KERNEL);
+  }
 
   // Zero any extra memory desired
-  if (phdr->p_filesz < phdr->p_memsz) {
-    memset((void *)(phdr->p_paddr + phdr->p_filesz), 0,
-           phdr->p_memsz - phdr->p_filesz);
+  trace_begin(BSS);
+  if (filesz < memsz) {
+    memset((void *)(paddr + filesz), 0, memsz - filesz);
   }
+  trace_end(BSS);
 
   void (*start_kernel)(int, const char *const *, const char *const *, int *) =
-      (void *)ptr->e_entry;
+      (void *)entry;
 
-  sprintf(buf, "Entry: %p\n", (void *)ptr->e_entry);
+  sprintf(buf, "Entry: %p\n", (void *)entry);
   printf(buf);
 
-  // initialize hdrbuf to zero
-  memset((void *)hdrbuf, 0, 256);
+  trace_begin(ARGS);
 
   // Fill out our disk info
-  sprintf((char *)hdrbuf, "n64cart.start=%u", 0xB0101000 + diskoff);
-  sprintf((char *)hdrbuf + 128, "n64cart.size=%u", disksize);
-
-  sprintf(buf, "Disk: %u\n", diskoff);
+  add_arg("n64cart.start=%u", disk_addr);
+  add_arg("n64cart.size=%u", disksize);
+  variant_args();
+  readahead_args();
+  mapped_args();
+
+  if (verity_args())
+    add_arg("root=/dev/dm-0");
+  else
+    add_arg("root=/dev/n64cart");
+
+#ifdef DEVBOOT
+  if (dev)
+    initrd_args(paddr + memsz);
+#endif
+
+  // Staged now so the map below accounts for it
+  u32 cmdlen = 0;
+  const char *const cmdline = (const char *)small_payload(PL_CMDLINE, &cmdlen);
+
+  // What is left where, with the resident block kept from the kernel
+  const u32 heap = PhysicalAddr(end), stack = arena_limit();
+  memmap_add(MM_LOADER_BASE, heap - MM_LOADER_BASE, "loader", MM_LOADER);
+  memmap_add(heap, PhysicalAddr(sbrk(0)) - heap, "heap, console", MM_LOADER);
+  memmap_add(stack - arena_used(), arena_used(), "staging", MM_LOADER);
+  memmap_add(stack, osMemSize - stack, "stack", MM_LOADER);
+  memmap_add(paddr, memsz, "kernel", MM_KERNEL);
+  memmap_add(resident_addr(), RESIDENT_SIZE, "resident", MM_KEEP);
+  memmap_print(osMemSize);
+
+  u32 memstart[MM_MAX + 1], memlen[MM_MAX + 1];
+  const unsigned nmem = memmap_usable(osMemSize, memstart, memlen, MM_MAX + 1);
+  for (unsigned i = 0; i < nmem; i++)
+    add_arg("mem=%lu@%lu", (unsigned long)memlen[i], (unsigned long)memstart[i]);
+
+  // The user's arguments last, so they can't crowd out the ones above
+  if (cmdline)
+    cmdline_args(cmdline, cmdlen);
+
+  sprintf(buf, "Disk: %p\n", (void *)disk_addr);
   printf(buf);
 
-  printf("%s\n", (const char *)hdrbuf);
-  printf("%s\n", (const char *)hdrbuf + 128);
+  for (int i = 1; i < nargs; i++)
+    printf("%s\n", args[i]);
+
+  trace_end(ARGS);
 
   sprintf(buf, "Jumping to: %p\n", (void *)start_kernel);
   printf(buf);
 
+  // Arguments move into the resident block, where a re-entry finds them
+  const char *const *const kargs = resident_args(&nargs, args);
+
+  trace_begin(DELAY);
   wait_ms(1024);
+  trace_end(DELAY);
+
+  trace_end(BOOT);
+  trace_dump();
+
+  telem_record(sys_reset_type() == RESET_WARM ? TELEM_WARM : TELEM_COLD,
+               verify);
 
   disable_interrupts();
   set_VI_interrupt(0, 0);
 
-  start_kernel(sizeof(args) / sizeof(args[0]), args, NULL, NULL /* unused */);
+  start_kernel(nargs, kargs, NULL, (int *)resident_addr());
 
   return 0;
 }
@@ -0,0 +1,106 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <stdio.h>
+
+#include "memmap.h"
+
+struct region {
+  uint32_t start, end; /* physical */
+  const char *what;
+  int kind;
+};
+
+// Sorted by start
+static struct region map[MM_MAX];
+static unsigned nregions;
+
+void memmap_add(uint32_t start, uint32_t len, const char *what, int kind) {
+  unsigned i;
+
+  if (!len || nregions >= MM_MAX)
+    return;
+
+  start = PhysicalAddr(start);
+  for (i = nregions++; i && map[i - 1].start > start; i--)
+    map[i] = map[i - 1];
+
+  map[i].start = start;
+  map[i].end = start + len;
+  map[i].what = what;
+  map[i].kind = kind;
+}
+
+// Bytes covered by the regions of the kinds in mask, overlaps counted once
+static uint32_t covered(unsigned mask, uint32_t memsize) {
+  uint32_t total = 0, reach = 0;
+  unsigned i;
+
+  for (i = 0; i < nregions; i++) {
+    if (!(mask & 1 << map[i].kind))
+      continue;
+    const uint32_t s = map[i].start > reach ? map[i].start : reach;
+    const uint32_t e = map[i].end < memsize ? map[i].end : memsize;
+    if (e > s)
+      total += e - s;
+    if (map[i].end > reach)
+      reach = map[i].end;
+  }
+  return total;
+}
+
+void memmap_print(uint32_t memsize) {
+  static const char *const kinds[] = {"", " [kernel]", " [kept]"};
+  unsigned i;
+
+  printf("RAM map of %lu kb:\n", (unsigned long)memsize / 1024);
+  for (i = 0; i < nregions; i++)
+    printf("%08lx-%08lx %5lu kb %s%s\n", (unsigned long)map[i].start,
+           (unsigned long)map[i].end - 1,
+           (unsigned long)(map[i].end - map[i].start) / 1024, map[i].what,
+           kinds[map[i].kind]);
+
+  printf("Free at handoff: %lu kb, left to the kernel: %lu kb\n",
+         (unsigned long)(memsize - covered(1 << MM_LOADER | 1 << MM_KERNEL | 1 << MM_KEEP, memsize)) / 1024,
+         (unsigned long)(memsize -
+                         covered(1 << MM_KERNEL | 1 << MM_KEEP, memsize)) /
+             1024);
+}
+
+/* The ranges the kernel may use: all of RAM but the kept regions. Returns
+ * how many, up to max. */
+unsigned memmap_usable(uint32_t memsize, uint32_t *start, uint32_t *len,
+                       unsigned max) {
+  uint32_t from = 0;
+  unsigned i, n = 0;
+
+  for (i = 0; i <= nregions && n < max; i++) {
+    const int last = i == nregions;
+    if (!last && map[i].kind != MM_KEEP)
+      continue;
+
+    const uint32_t to = last || map[i].start > memsize ? memsize : map[i].start;
+    if (to > from) {
+      start[n] = from;
+      len[n++] = to - from;
+    }
+    if (!last && map[i].end > from)
+      from = map[i].end;
+  }
+  return n;
+}
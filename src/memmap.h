@@ -0,0 +1,54 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* RAM occupancy at handoff.
+ *
+ * Before jumping to the kernel the loader records what it leaves in
+ * RDRAM: its own image and heap, which holds the console framebuffers,
+ * the staging arena and stack, the kernel, and what is kept for later.
+ * The map is printed, and the kernel is given mem= ranges around the
+ * kept regions. util/rammap predicts the same map from a packed ROM. */
+
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stdint.h>
+
+/* Physical address the loader runs from: where IPL3 puts it, or where
+ * stage 0 puts stage 1, see src/stage0.c */
+#ifdef STAGE1_BASE
+#define MM_LOADER_BASE (STAGE1_BASE & 0x1FFFFFFF)
+#else
+#define MM_LOADER_BASE 0x400
+#endif
+
+/* Region kinds. Loader regions are reclaimed by the kernel, kernel
+ * regions belong to it already, kept ones are withheld from it. */
+#define MM_LOADER 0
+#define MM_KERNEL 1
+#define MM_KEEP 2
+
+#define MM_MAX 12
+
+#ifdef N64
+void memmap_add(uint32_t start, uint32_t len, const char *what, int kind);
+void memmap_print(uint32_t memsize);
+unsigned memmap_usable(uint32_t memsize, uint32_t *start, uint32_t *len,
+                       unsigned max);
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+
+#include "pidma.h"
+#include "trace.h"
+
+#define PI_REG(off) (*(volatile uint32_t *)(0xA4600000 + (off)))
+#define PI_DRAM_ADDR 0x00
+#define PI_CART_ADDR 0x04
+#define PI_WR_LEN 0x0C /* cart to RAM */
+#define PI_STATUS 0x10
+
+#define PI_STATUS_DMA_BUSY 0x01
+#define PI_STATUS_IO_BUSY 0x02
+#define PI_STATUS_CLR_INTR 0x02 /* on write */
+
+// The transfer in flight, for the trace
+static int pending = -1;
+static uint32_t pending_len;
+
+int pi_dma_busy(void) {
+  return PI_REG(PI_STATUS) & (PI_STATUS_DMA_BUSY | PI_STATUS_IO_BUSY);
+}
+
+void pi_dma_wait(void) {
+  while (pi_dma_busy())
+    ;
+
+  if (pending >= 0) {
+    PI_REG(PI_STATUS) = PI_STATUS_CLR_INTR;
+    trace_event(TRACE_END, TRACE_PI, pending, pending_len);
+    pending = -1;
+  }
+}
+
+void pi_dma_start(void *ram, uint32_t cart, uint32_t len, int trace_id) {
+  pi_dma_wait();
+
+  data_cache_hit_writeback_invalidate(ram, len);
+
+  pending = trace_id;
+  pending_len = len;
+  trace_event(TRACE_BEGIN, TRACE_PI, trace_id, len);
+
+  PI_REG(PI_DRAM_ADDR) = PhysicalAddr(ram);
+  PI_REG(PI_CART_ADDR) = PhysicalAddr(cart);
+  PI_REG(PI_WR_LEN) = len - 1;
+}
@@ -0,0 +1,38 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Non-blocking PI DMA.
+ *
+ * libdragon's dma_read() spins until the transfer is done. pi_dma_start()
+ * only programs the PI and returns, so the CPU can get on with setup while
+ * the cart is read, and pi_dma_wait() collects the transfer before the
+ * data is used. One transfer is in flight at a time; starting another
+ * waits for it. The destination is written back and invalidated in the
+ * data cache on start and must not be touched until the wait. Transfers
+ * show up on the PI track of the boot trace under the given trace id. */
+
+#ifndef PIDMA_H
+#define PIDMA_H
+
+#include <stdint.h>
+
+/* ram 8-byte aligned, cart and len even */
+void pi_dma_start(void *ram, uint32_t cart, uint32_t len, int trace_id);
+int pi_dma_busy(void);
+void pi_dma_wait(void);
+
+#endif
@@ -0,0 +1,99 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "resident.h"
+
+// The stub, in resident_stub.S
+extern const char resident_start[], resident_end[];
+
+_Static_assert(offsetof(struct resident, argc) == RS_ARGC, "RS_ARGC");
+_Static_assert(offsetof(struct resident, argv) == RS_ARGV, "RS_ARGV");
+_Static_assert(offsetof(struct resident, npayloads) == RS_NPAYLOADS,
+               "RS_NPAYLOADS");
+_Static_assert(offsetof(struct resident, payload) == RS_PAYLOAD,
+               "RS_PAYLOAD");
+_Static_assert(sizeof(struct resident_payload) == RS_PAYLOAD_SIZE,
+               "RS_PAYLOAD_SIZE");
+_Static_assert(offsetof(struct resident, hdr) == RS_HDR, "RS_HDR");
+_Static_assert(RESIDENT_DATA + sizeof(struct resident) <= RESIDENT_SIZE,
+               "struct resident");
+
+static uint8_t *block;
+static struct resident *rs;
+
+// Called first thing after the arena is set up, so the block sits right
+// below the stack and leaves the rest of RAM in one piece
+void resident_init(void) {
+  if (resident_end - resident_start > RESIDENT_DATA) {
+    printf("Resident stub too large, halting...\n");
+
+    while (1)
+      ;
+  }
+
+  block = arena_alloc(RESIDENT_SIZE);
+  rs = (struct resident *)(block + RESIDENT_DATA);
+
+  memset(block, 0, RESIDENT_SIZE);
+  memcpy(block, resident_start, resident_end - resident_start);
+  rs->magic = RESIDENT_MAGIC;
+}
+
+void resident_add(unsigned id, uint32_t cart, uint32_t size) {
+  if (rs->npayloads >= RS_MAX_PAYLOADS)
+    return;
+
+  struct resident_payload *const p = &rs->payload[rs->npayloads++];
+  p->id = id;
+  p->cart = cart;
+  p->size = size;
+}
+
+/* Copy the kernel arguments into the block, where they outlive the loader,
+ * and publish it. Returns the copy to hand to the kernel, and trims *argc
+ * to the arguments that fit in it. */
+const char *const *resident_args(int *argc, const char *const *argv) {
+  unsigned pos = 0;
+  int i;
+
+  for (i = 0; i < *argc && i < RS_MAX_ARGS; i++) {
+    const unsigned len = strlen(argv[i]) + 1;
+
+    if (pos + len > sizeof(rs->argbuf))
+      break;
+    memcpy(rs->argbuf + pos, argv[i], len);
+    rs->args[i] = (uint32_t)(rs->argbuf + pos);
+    pos += len;
+  }
+
+  rs->args[i] = 0;
+  rs->argc = *argc = i;
+  rs->argv = (uint32_t)rs->args;
+
+  data_cache_hit_writeback(block, RESIDENT_SIZE);
+  inst_cache_hit_invalidate(block, RESIDENT_DATA);
+
+  return (const char *const *)rs->args;
+}
+
+uint32_t resident_addr(void) { return (uint32_t)block; }
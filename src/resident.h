@@ -0,0 +1,88 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Resident re-entry stub.
+ *
+ * The loader leaves a 4 KB block near the top of RAM and keeps it out of
+ * the kernel's memory with mem= arguments. The block holds a small
+ * position-independent loader, the cart locations of the bootable
+ * kernels and a copy of the kernel arguments. Its address is passed as
+ * the fourth argument of the kernel entry point.
+ *
+ * A kernel switches kernels by jumping to that address in kernel mode,
+ * with a0 holding the PL_* id of the kernel payload to boot. The stub
+ * loads the ELF straight from the cart, skipping everything main() does,
+ * and enters it with the same arguments and the same fourth argument.
+ * If there is no such payload, or it is not a 32-bit ELF that fits
+ * around the block, the stub returns -1 to the caller instead, with the
+ * interrupt enable restored and the PI interrupt of its header read
+ * cleared. It may have written back and dropped the data cache.
+ *
+ * Compressed kernels are not handled here; the stub has no decoder. */
+
+#ifndef RESIDENT_H
+#define RESIDENT_H
+
+#define RESIDENT_MAGIC 0x52534454 /* "RSDT" */
+#define RESIDENT_SIZE 4096
+
+/* Stub code at the start of the block, its data from here on */
+#define RESIDENT_DATA 0x300
+
+/* Layout of struct resident, for the stub */
+#define RS_MAGIC 0
+#define RS_ARGC 4
+#define RS_ARGV 8
+#define RS_NPAYLOADS 12
+#define RS_PAYLOAD 16
+#define RS_PAYLOAD_SIZE 12
+#define RS_MAX_PAYLOADS 8
+#define RS_HDR (RS_PAYLOAD + RS_MAX_PAYLOADS * RS_PAYLOAD_SIZE)
+#define RS_HDR_SIZE 256
+#define RS_MAX_ARGS 24
+#define RS_ARGBUF 1024
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+struct resident_payload {
+  uint16_t id; /* PL_* */
+  uint16_t pad;
+  uint32_t cart; /* cart address */
+  uint32_t size;
+};
+
+struct resident {
+  uint32_t magic;
+  uint32_t argc;
+  uint32_t argv; /* args, as passed to the kernel */
+  uint32_t npayloads;
+  struct resident_payload payload[RS_MAX_PAYLOADS];
+  uint8_t hdr[RS_HDR_SIZE]; /* ELF header scratch */
+  uint32_t args[RS_MAX_ARGS + 1]; /* into argbuf */
+  char argbuf[RS_ARGBUF];
+};
+
+void resident_init(void);
+void resident_add(unsigned id, uint32_t cart, uint32_t size);
+const char *const *resident_args(int *argc, const char *const *argv);
+uint32_t resident_addr(void);
+
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Stage 0 of the two-stage loader, see TWOSTAGE in the Makefile.
+ *
+ * This is all IPL3 copies, so it is kept to PI DMA and the LZB block
+ * decoder. It reads the boot table page and boots a plain ELF kernel
+ * itself when the ROM asks for nothing more than the kernel and the disk.
+ * Otherwise, or when that fails, it decodes stage 1, the full loader in
+ * main.c, from its LZB payload to the high address it is linked at and
+ * jumps there. Stage 1 then starts over as if IPL3 had started it. There
+ * is no console here; errors are reported by stage 1. */
+
+#include <libdragon.h>
+#include <string.h>
+
+#include "boottab.h"
+#include "elf32.h"
+#include "lzb.h"
+#include "pidma.h"
+#include "trace.h"
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+extern char end[]; /* end of stage 0, where its heap starts */
+
+#define STAGE1_MAX_BLOCKS 512 /* 1 MB decoded */
+
+static u8 page[0x1000] __attribute__((aligned(16)));
+static u8 hdr[256] __attribute__((aligned(16)));
+static u16 table[STAGE1_MAX_BLOCKS] __attribute__((aligned(16)));
+static u8 stage[2][LZB_BLOCK] __attribute__((aligned(16)));
+
+// Whether [start, start + len) lands on stage 0 or its stack
+static int overlaps_self(u32 start, u32 len) {
+  const u32 s = PhysicalAddr(start);
+  const u32 sp = PhysicalAddr(__builtin_frame_address(0)) - 4096;
+
+  return (s < PhysicalAddr(end) && s + len > 0x400) || s + len > sp;
+}
+
+static char *put_u32(char *p, u32 v) {
+  char digits[10];
+  unsigned n = 0;
+
+  do
+    digits[n++] = '0' + v % 10;
+  while (v /= 10);
+  while (n)
+    *p++ = digits[--n];
+  *p++ = 0;
+  return p;
+}
+
+/* Boot the kernel with no more than stage 1 would give it without any
+ * boot table records. Returns if the ROM wants more, before touching
+ * RAM, and always with DEVBOOT, where only stage 1 looks for a USB host. */
+static void direct_boot(int table_ok, u32 kernel_addr, u32 disk_addr,
+                        u32 disksize) {
+  static char argbuf[64];
+  static const char *args[4] = {"hello"};
+  unsigned len, off = sizeof(struct boottab_hdr), i;
+
+#ifdef DEVBOOT
+  (void)table_ok, (void)kernel_addr, (void)disk_addr, (void)disksize;
+  return;
+#endif
+
+  // Any record but the layout is for stage 1, and so is any payload
+  // stage 0 has no use for
+  if (table_ok) {
+    const unsigned size = ((const struct boottab_hdr *)page)->size;
+    while (off + sizeof(struct boottab_rec) <= size) {
+      const struct boottab_rec *const rec = (const void *)(page + off);
+      if (rec->tag != BT_LAYOUT)
+        return;
+      off += sizeof(*rec) + ((rec->len + 3) & ~3);
+    }
+  }
+  const struct bt_payload *const pl = boottab_find(BT_LAYOUT, &len);
+  for (i = 0; pl && i < len / sizeof(*pl); i++)
+    if (pl[i].id != PL_KERNEL && pl[i].id != PL_DISK && pl[i].id != PL_STAGE1)
+      return;
+
+  pi_dma_start(hdr, kernel_addr, sizeof(hdr), TRACE_ELFHDR);
+  pi_dma_wait();
+
+  const Elf32_Ehdr *const eh = (const Elf32_Ehdr *)hdr;
+  if (memcmp(eh->e_ident, "\177ELF", 4) || eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+      eh->e_phoff > sizeof(hdr) - sizeof(Elf32_Phdr))
+    return;
+
+  const Elf32_Phdr *ph = (const Elf32_Phdr *)(hdr + eh->e_phoff);
+  while (ph->p_type != 1)
+    if ((const u8 *)++ph > hdr + sizeof(hdr) - sizeof(*ph))
+      return;
+
+  const u32 paddr = ph->p_paddr, filesz = ph->p_filesz, memsz = ph->p_memsz;
+  if ((paddr & 7) || filesz > memsz || overlaps_self(paddr, memsz))
+    return;
+
+  pi_dma_start((void *)paddr, kernel_addr + ph->p_offset, (filesz + 1) & ~1,
+               TRACE_KERNEL);
+  pi_dma_wait();
+  memset((void *)(paddr + filesz), 0, memsz - filesz);
+  data_cache_hit_writeback_invalidate((void *)paddr, memsz);
+
+  char *p = argbuf;
+  args[1] = p;
+  memcpy(p, "n64cart.start=", 14);
+  p = put_u32(p + 14, disk_addr);
+  args[2] = p;
+  memcpy(p, "n64cart.size=", 13);
+  p = put_u32(p + 13, disksize);
+  args[3] = "root=/dev/n64cart";
+
+  void (*const start_kernel)(int, const char *const *, const char *const *,
+                             int *) = (void *)eh->e_entry;
+  disable_interrupts();
+  start_kernel(4, args, NULL, NULL);
+}
+
+/* Decode stage 1 block by block, fetching the next block while the
+ * current one decodes, and enter it */
+static void stage1_boot(const struct bt_payload *pl) {
+  const u32 cart = ROM_ADDR(pl->offset);
+  const struct lzb_hdr *const lz = (const struct lzb_hdr *)hdr;
+  u32 i, k;
+
+  pi_dma_start(hdr, cart, sizeof(*lz), TRACE_ELFHDR);
+  pi_dma_wait();
+
+  const u32 n = lz->nblocks;
+  u8 *const dest = (u8 *)lz->load;
+  if (lz->magic != LZB_MAGIC || n > STAGE1_MAX_BLOCKS ||
+      n != (lz->usize + LZB_BLOCK - 1) / LZB_BLOCK || lz->usize > lz->memsz ||
+      overlaps_self(lz->load, lz->memsz))
+    return;
+
+  pi_dma_start(table, cart + sizeof(*lz), (2 * n + 1) & ~1, TRACE_DECOMP);
+  pi_dma_wait();
+  for (i = 0; i < n; i++)
+    if (table[i] > LZB_ALIGN8(LZB_BLOCK_SIZE(lz->usize, i)))
+      return;
+
+  u32 src = cart + LZB_DATA_OFFSET(n);
+  if (n)
+    pi_dma_start(stage[0], src, (table[0] + 1) & ~1, TRACE_DECOMP);
+
+  for (i = 0, k = 0; i < n; i++, k ^= 1) {
+    const u32 csize = table[i], bsize = LZB_BLOCK_SIZE(lz->usize, i);
+
+    pi_dma_wait();
+    src += csize;
+    if (i + 1 < n)
+      pi_dma_start(stage[k ^ 1], src, (table[i + 1] + 1) & ~1, TRACE_DECOMP);
+
+    if (csize == LZB_ALIGN8(bsize))
+      memcpy(dest + i * LZB_BLOCK, stage[k], bsize);
+    else if (lzb_decode_block(stage[k], csize, dest + i * LZB_BLOCK, bsize))
+      return;
+  }
+  pi_dma_wait();
+
+  memset(dest + lz->usize, 0, lz->memsz - lz->usize);
+  data_cache_hit_writeback_invalidate(dest, lz->memsz);
+  inst_cache_hit_invalidate(dest, lz->memsz);
+
+  disable_interrupts();
+  ((void (*)(void))lz->entry)();
+}
+
+int main(void) {
+  u32 kernel_addr = 0xB0101000, disk_addr, disksize;
+
+  pi_dma_start(page, BOOTTAB_ADDR, sizeof(page), TRACE_BOOTTAB);
+  pi_dma_wait();
+  const int table_ok = !boottab_load(page);
+
+  // As in stage 1: the fixed layout unless a layout record moves things
+  const u32 kernelsize = *(u32 *)(page + 0xFFC);
+  disksize = *(u32 *)(page + 0xFF8);
+  disk_addr = kernel_addr + ((kernelsize + 4095) & ~4095);
+
+  const struct bt_payload *const kpl = payload_find(PL_KERNEL);
+  const struct bt_payload *const dpl = payload_find(PL_DISK);
+  if (kpl)
+    kernel_addr = ROM_ADDR(kpl->offset);
+  if (dpl) {
+    disk_addr = ROM_ADDR(dpl->offset);
+    disksize = dpl->size;
+  }
+
+  if (kernelsize || kpl)
+    direct_boot(table_ok, kernel_addr, disk_addr, disksize);
+
+  const struct bt_payload *const s1 = payload_find(PL_STAGE1);
+  if (s1)
+    stage1_boot(s1);
+
+  while (1)
+    ;
+}
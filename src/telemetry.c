@@ -0,0 +1,107 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <string.h>
+
+#include "arena.h"
+#include "telemetry.h"
+#include "trace.h"
+
+#define PI_REG(off) (*(volatile uint32_t *)(0xA4600000 + (off)))
+#define PI_BSD_DOM1_LAT 0x14
+#define PI_BSD_DOM1_PWD 0x18
+#define PI_BSD_DOM1_PGS 0x1C
+#define PI_BSD_DOM1_RLS 0x20
+#define PI_BSD_DOM2_LAT 0x24
+#define PI_BSD_DOM2_PWD 0x28
+#define PI_BSD_DOM2_PGS 0x2C
+#define PI_BSD_DOM2_RLS 0x30
+
+#define SRAM_ADDR 0xA8000000
+
+static uint32_t telem_sum(const struct telem_log *l) {
+  const uint32_t *w = (const uint32_t *)l;
+  const uint32_t *const end = &l->sum;
+  uint32_t sum = 0;
+
+  while (w < end)
+    sum += *w++;
+  return sum;
+}
+
+// Duration of the first begin/end pair of each CPU phase
+static void telem_phases(struct telem_boot *b) {
+  unsigned i, j;
+
+  b->nphases = TRACE_NUM_IDS < TELEM_PHASES ? TRACE_NUM_IDS : TELEM_PHASES;
+  memset(b->phase, 0, sizeof(b->phase));
+
+  for (i = 0; i < trace.nevents; i++) {
+    const struct trace_event *const ev = &trace.ev[i];
+    if (ev->track != TRACE_CPU || ev->kind != TRACE_BEGIN ||
+        ev->id >= b->nphases || b->phase[ev->id])
+      continue;
+
+    for (j = i + 1; j < trace.nevents; j++) {
+      const struct trace_event *const end = &trace.ev[j];
+      if (end->track == TRACE_CPU && end->kind == TRACE_END &&
+          end->id == ev->id) {
+        b->phase[ev->id] = end->count - ev->count;
+        break;
+      }
+    }
+  }
+}
+
+/* Append this boot to the SRAM log. One read and one write, both issued
+ * here so the rest of the boot path never waits on the slow SRAM domain. */
+void telem_record(int reset, int verify) {
+  PI_REG(PI_BSD_DOM2_LAT) = 0x05;
+  PI_REG(PI_BSD_DOM2_PWD) = 0x0C;
+  PI_REG(PI_BSD_DOM2_PGS) = 0x0D;
+  PI_REG(PI_BSD_DOM2_RLS) = 0x02;
+
+  struct telem_log *const telem = arena_alloc(sizeof(*telem));
+
+  data_cache_hit_writeback_invalidate(telem, sizeof(*telem));
+  dma_read(telem, SRAM_ADDR + TELEM_SRAM_OFFSET, sizeof(*telem));
+
+  if (telem->magic != TELEM_MAGIC || telem->version != TELEM_VERSION ||
+      telem->slots != TELEM_SLOTS || telem->sum != telem_sum(telem)) {
+    memset(telem, 0, sizeof(*telem));
+    telem->magic = TELEM_MAGIC;
+    telem->version = TELEM_VERSION;
+    telem->slots = TELEM_SLOTS;
+  }
+
+  struct telem_boot *const b = &telem->boot[telem->head % TELEM_SLOTS];
+  b->seq = ++telem->bootcount;
+  b->reset = reset;
+  b->verify = verify;
+  b->pi_timing = (PI_REG(PI_BSD_DOM1_LAT) & 0xFF) << 24 |
+                 (PI_REG(PI_BSD_DOM1_PWD) & 0xFF) << 16 |
+                 (PI_REG(PI_BSD_DOM1_PGS) & 0xFF) << 8 |
+                 (PI_REG(PI_BSD_DOM1_RLS) & 0xFF);
+  telem_phases(b);
+
+  telem->head = (telem->head + 1) % TELEM_SLOTS;
+  telem->sum = telem_sum(telem);
+
+  data_cache_hit_writeback(telem, sizeof(*telem));
+  dma_write(telem, SRAM_ADDR + TELEM_SRAM_OFFSET, sizeof(*telem));
+}
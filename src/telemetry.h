@@ -0,0 +1,72 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Boot telemetry kept in cartridge SRAM.
+ *
+ * A rolling log of the last TELEM_SLOTS boots lives at the end of the
+ * 32 KB SRAM. The loader reads, updates and writes it back in one go right
+ * before jumping to the kernel, so it costs two short PI DMAs per boot.
+ * util/telem2csv decodes a save dump. Shared with the host tools; all
+ * fields are big-endian. */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEM_MAGIC 0x424F4F54 /* "BOOT" */
+#define TELEM_VERSION 1
+#define TELEM_SLOTS 8
+#define TELEM_PHASES 16
+
+/* Offset of the log in SRAM, leaving the rest for the OS */
+#define TELEM_SRAM_OFFSET 0x7C00
+
+/* Reset types */
+#define TELEM_COLD 0
+#define TELEM_WARM 1
+
+/* Verification outcome bits */
+#define TELEM_V_NOELF 0x01 /* kernel has no ELF magic */
+#define TELEM_V_NOT32 0x02 /* kernel is not ELFCLASS32 */
+
+struct telem_boot {
+  uint32_t seq;    /* boot number this slot was written on */
+  uint8_t reset;   /* TELEM_COLD or TELEM_WARM */
+  uint8_t verify;  /* TELEM_V_* bits */
+  uint8_t nphases; /* valid entries in phase[] */
+  uint8_t pad;
+  uint32_t pi_timing;             /* DOM1 LAT << 24 | PWD << 16 | PGS << 8 | RLS */
+  uint32_t phase[TELEM_PHASES];   /* COP0 ticks per TRACE_* id, 0 if not run */
+};
+
+struct telem_log {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slots;
+  uint32_t bootcount;
+  uint32_t head; /* next slot to write */
+  struct telem_boot boot[TELEM_SLOTS];
+  uint32_t sum; /* sum of all preceding words */
+  uint32_t pad;
+};
+
+#ifdef N64
+void telem_record(int reset, int verify);
+#endif
+
+#endif
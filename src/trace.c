@@ -0,0 +1,49 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include <libdragon.h>
+#include <stdio.h>
+
+#include "trace.h"
+
+struct trace_buf trace __attribute__((aligned(16))) = {TRACE_MAGIC, 0, {}};
+
+void trace_event(int kind, int track, int id, uint32_t arg) {
+  const uint32_t count = C0_COUNT();
+
+  if (trace.nevents >= TRACE_MAX_EVENTS)
+    return;
+
+  struct trace_event *const ev = &trace.ev[trace.nevents++];
+  ev->count = count;
+  ev->kind = kind;
+  ev->track = track;
+  ev->id = id;
+  ev->arg = arg;
+}
+
+// One line per event, parsed by util/trace2json. stderr goes to whatever
+// debug channel libdragon was told to use, not to the console.
+void trace_dump(void) {
+  unsigned i;
+
+  for (i = 0; i < trace.nevents; i++) {
+    const struct trace_event *const ev = &trace.ev[i];
+    fprintf(stderr, "@T %u %u %u %08lx %lu\n", ev->kind, ev->track, ev->id,
+            (unsigned long)ev->count, (unsigned long)ev->arg);
+  }
+}
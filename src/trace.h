@@ -0,0 +1,99 @@
+/*  n64bootloader, a Linux bootloader for the N64
+    Copyright (C) 2020 Lauri Kasanen
+    Copyright (C) 2022 James Shield
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/* Boot timeline trace.
+ *
+ * The loader stamps the COP0 Count register at the start and end of each
+ * phase of main() and around every DMA it issues. The records live in a
+ * static buffer that can be found in a RAM dump by its magic, and are also
+ * printed as "@T" lines to the debug log. util/trace2json turns either form
+ * into Chrome trace JSON.
+ *
+ * This header is shared with the host tools, so everything outside the
+ * N64 block must stay plain C. All fields are big-endian in RAM. */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x42545243 /* "BTRC" */
+#define TRACE_MAX_EVENTS 128
+
+/* COP0 Count increments at half the 93.75 MHz VR4300 pipeline clock */
+#define TRACE_COUNT_HZ 46875000
+
+/* Event kinds */
+#define TRACE_BEGIN 0
+#define TRACE_END 1
+
+/* Tracks, one per unit that can be busy at the same time */
+#define TRACE_CPU 0
+#define TRACE_PI 1
+#define TRACE_SP 2
+#define TRACE_TRACKS 3
+
+/* Phase and span ids. Append only: the ids end up in dumps. */
+#define TRACE_IDS(X)                                                           \
+  X(BOOT, "boot")                                                              \
+  X(CONSOLE, "console_init")                                                   \
+  X(RAMSIZE, "ram size")                                                       \
+  X(SIZEWORDS, "size words")                                                   \
+  X(ELFHDR, "elf header")                                                      \
+  X(KERNEL, "kernel load")                                                     \
+  X(BSS, "bss clear")                                                          \
+  X(ARGS, "args")                                                              \
+  X(DELAY, "delay")                                                            \
+  X(BOOTTAB, "boot table")                                                     \
+  X(DECOMP, "decompress")                                                      \
+  X(DEVUSB, "usb dev boot")                                                    \
+  X(EARLY, "early read")                                                       \
+  X(EARLYWAIT, "early read wait")
+
+#define TRACE_ENUM(id, name) TRACE_##id,
+enum { TRACE_IDS(TRACE_ENUM) TRACE_NUM_IDS };
+#undef TRACE_ENUM
+
+struct trace_event {
+  uint32_t count; /* COP0 Count */
+  uint8_t kind;   /* TRACE_BEGIN or TRACE_END */
+  uint8_t track;  /* TRACE_CPU, TRACE_PI, TRACE_SP */
+  uint16_t id;    /* TRACE_* id */
+  uint32_t arg;   /* bytes moved, for DMA spans */
+};
+
+struct trace_buf {
+  uint32_t magic;
+  uint32_t nevents;
+  struct trace_event ev[TRACE_MAX_EVENTS];
+};
+
+#ifdef N64
+extern struct trace_buf trace;
+
+void trace_event(int kind, int track, int id, uint32_t arg);
+void trace_dump(void);
+
+#define trace_begin(id) trace_event(TRACE_BEGIN, TRACE_CPU, TRACE_##id, 0)
+#define trace_end(id) trace_event(TRACE_END, TRACE_CPU, TRACE_##id, 0)
+#define trace_dma_begin(track, id, len)                                        \
+  trace_event(TRACE_BEGIN, track, TRACE_##id, len)
+#define trace_dma_end(track, id, len)                                          \
+  trace_event(TRACE_END, track, TRACE_##id, len)
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+/* Big-endian accessors for ROM and RAM images, which are always in N64
+ * byte order regardless of the host. */
+
+#ifndef BE_H
+#define BE_H
+
+#include <stdint.h>
+
+static inline uint16_t get_be16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_be32(const uint8_t *p) {
+	return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void put_be16(uint8_t *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+#endif
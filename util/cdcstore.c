@@ -0,0 +1,293 @@
+/* Build a deduplicated store for several disk variants.
+ *
+ * Each image is cut into content-defined chunks with a gear hash, in the
+ * normalized FastCDC style: cuts are harder to find below the average
+ * size and easier above it. Cuts fall on any byte, so an insertion only
+ * changes the chunks around it. Chunks are identified by their SHA-256
+ * and stored once, padded to CDC_ALIGN or to -p, such as 512 to keep
+ * them sector aligned in the store. Outputs the store that becomes
+ * the disk payload, the chunk maps of all variants back to back for the
+ * diskmap payload, and the variants boot table record. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "boottab.h"
+#include "sha256.h"
+#include "file.h"
+#include "rec.h"
+#include "be.h"
+
+#define MAX_VARIANTS (BOOTTAB_MAX / sizeof(struct bt_variant))
+
+static uint64_t gear[256];
+
+static size_t min_size = 2048, avg_size = 8192, max_size = 65536;
+static size_t pad = CDC_ALIGN;
+static uint64_t mask_small, mask_large;
+
+struct chunk {
+	uint8_t hash[SHA256_LEN];
+	uint32_t store_offset;
+	uint32_t size;
+};
+
+static struct chunk *table; /* open addressing on the hash */
+static size_t table_size, nunique;
+
+static uint8_t *store;
+static size_t store_len, store_cap;
+
+static uint64_t splitmix(uint64_t *s) {
+	uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// A mask with bits set bits spread over the top of the hash
+static uint64_t spread_mask(unsigned bits) {
+	uint64_t m = 0;
+	unsigned i;
+
+	for (i = 0; i < bits; i++)
+		m |= 1ull << (63 - i * 2);
+	return m;
+}
+
+static void cdc_init(void) {
+	uint64_t seed = 0x4E3634434443ull;
+	unsigned i, bits = 0;
+
+	for (i = 0; i < 256; i++)
+		gear[i] = splitmix(&seed);
+
+	while ((size_t) 1 << (bits + 1) <= avg_size)
+		bits++;
+	mask_small = spread_mask(bits + 1);
+	mask_large = spread_mask(bits ? bits - 1 : 0);
+}
+
+// Length of the chunk starting at data
+static size_t cut(const uint8_t *data, size_t len) {
+	uint64_t h = 0;
+	size_t i;
+
+	if (len <= min_size)
+		return len;
+	if (len > max_size)
+		len = max_size;
+
+	for (i = 0; i < len; i++) {
+		h = (h << 1) + gear[data[i]];
+
+		if (i + 1 < min_size)
+			continue;
+		if (!(h & (i + 1 < avg_size ? mask_small : mask_large)))
+			return i + 1;
+	}
+	return len;
+}
+
+static const struct chunk *add_chunk(const uint8_t *data, size_t len,
+				      int *fresh) {
+	uint8_t hash[SHA256_LEN];
+	struct sha256 s;
+	size_t i;
+
+	sha256_init(&s);
+	sha256_update(&s, data, len);
+	sha256_final(&s, hash);
+
+	for (i = get_be32(hash) % table_size; table[i].size;
+	     i = (i + 1) % table_size) {
+		if (!memcmp(table[i].hash, hash, SHA256_LEN) && table[i].size == len) {
+			*fresh = 0;
+			return &table[i];
+		}
+	}
+
+	const size_t padded = (len + pad - 1) / pad * pad;
+	if (store_len + padded > UINT32_MAX) {
+		puts("Store does not fit a 32-bit offset");
+		exit(1);
+	}
+	while (store_len + padded > store_cap) {
+		store_cap = store_cap ? store_cap * 2 : 1 << 20;
+		if (!(store = realloc(store, store_cap)))
+			abort();
+	}
+	memcpy(store + store_len, data, len);
+	memset(store + store_len + len, 0, padded - len);
+
+	memcpy(table[i].hash, hash, SHA256_LEN);
+	table[i].store_offset = store_len;
+	table[i].size = len;
+	store_len += padded;
+	nunique++;
+	*fresh = 1;
+	return &table[i];
+}
+
+static int parse_tv(const char *s) {
+	static const char *const tvs[] = { "pal", "ntsc", "mpal" };
+	unsigned i;
+
+	if (!strcmp(s, "any"))
+		return BT_TV_ANY;
+	for (i = 0; i < 3; i++)
+		if (!strcmp(s, tvs[i]))
+			return i;
+	return -1;
+}
+
+int main(int argc, char **argv) {
+	static uint8_t rec[MAX_VARIANTS * sizeof(struct bt_variant)];
+	uint8_t *maps = NULL;
+	size_t maps_len = 0, total = 0;
+	unsigned v;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:a:M:p:")) != -1) {
+		switch (opt) {
+		case 'm':
+			min_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			avg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pad = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	const unsigned nvariants = argc - optind - 3;
+	if (argc - optind < 4 || nvariants > MAX_VARIANTS || !min_size ||
+	    min_size > avg_size || avg_size > max_size || !pad ||
+	    pad % CDC_ALIGN) {
+usage:
+		printf("Usage: %s [-m min] [-a avg] [-M max] [-p pad] store.bin "
+		       "maps.bin variants.rec name:tv:image...\n", argv[0]);
+		printf("pad is a multiple of %u, tv is any, ntsc, pal or mpal\n",
+		       CDC_ALIGN);
+		return 1;
+	}
+
+	cdc_init();
+
+	for (v = 0; v < nvariants; v++) {
+		char *const spec = argv[optind + 3 + v];
+		const char *const name = strtok(spec, ":");
+		const char *const tvname = strtok(NULL, ":");
+		const char *const file = strtok(NULL, "");
+		size_t len, pos, nchunks = 0, fresh_bytes = 0;
+		int tv;
+
+		if (!name || !tvname || !file || strlen(name) > 16 ||
+		    (tv = parse_tv(tvname)) < 0) {
+			printf("Bad variant %s\n", spec);
+			return 1;
+		}
+
+		uint8_t *const img = load_file(file, &len);
+		if (!img) {
+			printf("Can't read %s\n", file);
+			return 1;
+		}
+		if (len > UINT32_MAX) {
+			printf("%s does not fit a 32-bit size\n", file);
+			return 1;
+		}
+		total += len;
+
+		// Every chunk could be new and as small as allowed
+		const size_t most = len / min_size + 1;
+		if ((nunique + most) * 2 > table_size) {
+			struct chunk *const old = table;
+			const size_t old_size = table_size;
+			size_t i;
+
+			table_size = (nunique + most) * 4;
+			if (!(table = calloc(table_size, sizeof(*table))))
+				abort();
+			for (i = 0; i < old_size; i++) {
+				size_t j;
+
+				if (!old[i].size)
+					continue;
+				for (j = get_be32(old[i].hash) % table_size; table[j].size;
+				     j = (j + 1) % table_size)
+					;
+				table[j] = old[i];
+			}
+			free(old);
+		}
+
+		const size_t map_at = maps_len;
+		const size_t room = sizeof(struct cdc_map_hdr) +
+				    most * sizeof(struct cdc_chunk);
+		if (!(maps = realloc(maps, maps_len + room)))
+			abort();
+		maps_len += sizeof(struct cdc_map_hdr);
+
+		for (pos = 0; pos < len; nchunks++) {
+			const size_t n = cut(img + pos, len - pos);
+			int fresh;
+
+			const struct chunk *const c = add_chunk(img + pos, n, &fresh);
+			put_be32(maps + maps_len, pos);
+			put_be32(maps + maps_len + 4, c->store_offset);
+			put_be32(maps + maps_len + 8, n);
+			maps_len += sizeof(struct cdc_chunk);
+			if (fresh)
+				fresh_bytes += n;
+			pos += n;
+		}
+
+		put_be32(maps + map_at, CDC_MAP_MAGIC);
+		put_be32(maps + map_at + 4, nchunks);
+		put_be32(maps + map_at + 8, len);
+		// Store size is only known at the end, see below
+
+		uint8_t *const r = rec + v * sizeof(struct bt_variant);
+		strncpy((char *) r, name, 16);
+		r[16] = tv;
+		put_be32(r + 20, map_at);
+		put_be32(r + 24, maps_len - map_at);
+		put_be32(r + 28, len);
+
+		printf("%-16s %9zu bytes, %6zu chunks, %9zu new\n", name, len,
+		       nchunks, fresh_bytes);
+		free(img);
+	}
+
+	for (v = 0; v < nvariants; v++)
+		put_be32(maps + get_be32(rec + v * sizeof(struct bt_variant) + 20) + 12,
+			 store_len);
+
+	printf("Store %zu bytes in %zu chunks for %zu bytes of variants, "
+	       "maps %zu bytes\n", store_len, nunique, total, maps_len);
+
+	if (save_file(argv[optind], store, store_len) ||
+	    save_file(argv[optind + 1], maps, maps_len) ||
+	    write_rec(argv[optind + 2], BT_VARIANTS, rec,
+		      nvariants * sizeof(struct bt_variant))) {
+		puts("Can't write output");
+		return 1;
+	}
+
+	free(store);
+	free(maps);
+	free(table);
+	return 0;
+}
@@ -0,0 +1,295 @@
+/* Development boot server, see src/devboot.h.
+ *
+ * Serves a kernel and an optional initrd to a loader built with
+ * DEVBOOT=1, over the EverDrive's USB serial device or a unix socket for
+ * an emulator bridge. With -t it instead runs the loader's own client code
+ * against a simulated link in this process, optionally capped to a given
+ * rate, checks every byte and reports the throughput. */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "boottab.h"
+#include "devboot.h"
+#include "file.h"
+#include "be.h"
+
+struct payload {
+	unsigned id;
+	uint8_t *data;
+	size_t size;
+};
+
+static struct payload payloads[2] = { { .id = PL_KERNEL }, { .id = PL_INITRD } };
+#define NPAYLOADS 2
+
+static double rate; /* bytes per second, 0 for no cap */
+static unsigned long requests;
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+	uint8_t *p = buf;
+
+	while (len) {
+		const ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+	const uint8_t *p = buf;
+
+	while (len) {
+		const ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static const struct payload *find(unsigned id) {
+	unsigned i;
+
+	for (i = 0; i < NPAYLOADS; i++)
+		if (payloads[i].id == id && payloads[i].data)
+			return &payloads[i];
+	return NULL;
+}
+
+// Answer requests until the other end goes away
+static void serve(int fd) {
+	static uint8_t out[DEV_BLOCK + DEV_CHUNK + DEV_BLOCK];
+	uint8_t req[sizeof(struct dev_req)];
+	const double start = now();
+	double sent = 0;
+
+	while (!read_all(fd, req, sizeof(req))) {
+		if (get_be32(req) != DEV_REQ_MAGIC) {
+			fprintf(stderr, "Bad request magic, ignored\n");
+			continue;
+		}
+
+		const unsigned id = get_be32(req + 4);
+		const uint32_t offset = get_be32(req + 8);
+		uint32_t len = get_be32(req + 12);
+		const struct payload *const p = find(id);
+		const size_t size = p ? p->size : 0;
+
+		if (len > DEV_CHUNK)
+			len = DEV_CHUNK;
+		if (offset >= size)
+			len = 0;
+		else if (len > size - offset)
+			len = size - offset;
+
+		const size_t total = DEV_BLOCK + (len + DEV_BLOCK - 1) / DEV_BLOCK * DEV_BLOCK;
+		memset(out, 0, total);
+		put_be32(out, DEV_RSP_MAGIC);
+		put_be32(out + 4, id);
+		put_be32(out + 8, size);
+		put_be32(out + 12, len);
+		if (len)
+			memcpy(out + DEV_BLOCK, p->data + offset, len);
+
+		if (rate > 0) {
+			const double wait = (sent + total) / rate - (now() - start);
+			if (wait > 0)
+				usleep(wait * 1e6);
+		}
+		if (write_all(fd, out, total))
+			break;
+		sent += total;
+		requests++;
+	}
+}
+
+/* Simulated link: the loader's transport over one end of a socketpair */
+static int sim_read(void *ctx, void *buf, uint32_t len) {
+	return read_all(*(int *) ctx, buf, len);
+}
+
+static int sim_write(void *ctx, const void *buf, uint32_t len) {
+	return write_all(*(int *) ctx, buf, len);
+}
+
+static int sim_ready(void *ctx) {
+	struct pollfd pfd = { *(int *) ctx, POLLIN, 0 };
+
+	return poll(&pfd, 1, 10) > 0;
+}
+
+static void *serve_thread(void *arg) {
+	serve(*(int *) arg);
+	return NULL;
+}
+
+static int simulate(void) {
+	static uint8_t bounce[DEV_BLOCK] __attribute__((aligned(8)));
+	static int fds[2];
+	struct dev_transport t = { sim_read, sim_write, sim_ready, &fds[1], bounce };
+	pthread_t tid;
+	unsigned i;
+	int ret = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) ||
+	    pthread_create(&tid, NULL, serve_thread, &fds[0])) {
+		perror("simulated link");
+		return 1;
+	}
+
+	const double start = now();
+	if (dev_hello(&t)) {
+		puts("No answer to the hello");
+		return 1;
+	}
+
+	size_t bytes = 0;
+	for (i = 0; i < NPAYLOADS; i++) {
+		const struct payload *const p = &payloads[i];
+		uint32_t size = 0;
+
+		if (!p->data)
+			continue;
+
+		// As the loader does: size, then the ELF header, then the rest
+		uint8_t *const got = malloc(p->size + 1);
+		const uint32_t head = p->size < 256 ? p->size : 256;
+		if (!got)
+			abort();
+
+		if (dev_read(&t, p->id, 0, NULL, 0, &size) || size != p->size ||
+		    dev_read(&t, p->id, 0, got, head, NULL) != (int) head ||
+		    dev_read(&t, p->id, head, got + head, size - head, NULL) !=
+			    (int) (size - head) ||
+		    memcmp(got, p->data, size)) {
+			printf("Payload %u: transfer mismatch\n", p->id);
+			ret = 1;
+		}
+		bytes += size;
+		free(got);
+	}
+
+	const double secs = now() - start;
+	shutdown(fds[1], SHUT_RDWR);
+	pthread_join(tid, NULL);
+
+	printf("%zu bytes in %lu requests, %.3f s, %.2f MB/s%s\n", bytes, requests,
+	       secs, secs > 0 ? bytes / secs / 1e6 : 0.0, ret ? ", FAILED" : "");
+	return ret;
+}
+
+static int open_tty(const char *path) {
+	struct termios tio;
+
+	const int fd = open(path, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio))
+		return -1;
+	cfmakeraw(&tio);
+	return tcsetattr(fd, TCSANOW, &tio) ? -1 : fd;
+}
+
+static int listen_unix(const char *path) {
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+		return -1;
+	strcpy(sa.sun_path, path);
+	unlink(path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *) &sa, sizeof(sa)) || listen(fd, 1))
+		return -1;
+	return fd;
+}
+
+int main(int argc, char **argv) {
+	const char *tty = NULL, *sock = NULL;
+	int opt, test = 0;
+
+	while ((opt = getopt(argc, argv, "d:s:tr:")) != -1) {
+		switch (opt) {
+		case 'd':
+			tty = optarg;
+			break;
+		case 's':
+			sock = optarg;
+			break;
+		case 't':
+			test = 1;
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (argc - optind < 1 || argc - optind > 2 || (!!tty + !!sock + test) != 1) {
+usage:
+		printf("Usage: %s -d /dev/ttyUSB0 kernel [initrd]\n", argv[0]);
+		printf("       %s -s socket kernel [initrd]\n", argv[0]);
+		printf("       %s -t [-r bytes/s] kernel [initrd]\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = 0; optind + i < argc; i++) {
+		if (!(payloads[i].data = load_file(argv[optind + i], &payloads[i].size))) {
+			printf("Can't read %s\n", argv[optind + i]);
+			return 1;
+		}
+	}
+
+	if (test)
+		return simulate();
+
+	if (tty) {
+		const int fd = open_tty(tty);
+		if (fd < 0) {
+			perror(tty);
+			return 1;
+		}
+		serve(fd);
+		return 0;
+	}
+
+	const int lfd = listen_unix(sock);
+	if (lfd < 0) {
+		perror(sock);
+		return 1;
+	}
+	while (1) {
+		const int fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		serve(fd);
+		close(fd);
+	}
+}
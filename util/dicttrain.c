@@ -0,0 +1,153 @@
+/* Dictionary training, after the FastCover trainer in zstd.
+ *
+ * Every 8-byte string (d-mer) of the samples is hashed and counted once
+ * per sample it occurs in, so content shared between payloads outweighs
+ * repeats inside one. The samples are then cut into one epoch per segment
+ * the dictionary has room for, and from each epoch the segment whose
+ * distinct d-mers score highest is taken. D-mers already taken count for
+ * nothing afterwards. Segments are placed from the end of the dictionary
+ * down, so the best ones sit closest to the data and get the shortest
+ * offsets. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzbcomp.h"
+
+#define DMER 8
+#define SEGMENT 256
+#define FREQ_BITS 20
+
+static unsigned dmer_hash(const uint8_t *p) {
+	uint64_t v;
+
+	memcpy(&v, p, DMER);
+	return (v * 0xCF1BBCDCB7A56463ull) >> (64 - FREQ_BITS);
+}
+
+struct corpus {
+	uint8_t *data;
+	size_t len;
+	uint32_t *freq;   /* samples containing each d-mer hash */
+	uint32_t *active; /* d-mers in the current window */
+};
+
+// Best segment of [begin, end), scored by its distinct d-mers
+static size_t best_segment(struct corpus *c, size_t begin, size_t end,
+			   size_t seg, uint64_t *score) {
+	const size_t window = seg - DMER + 1; /* d-mers in a segment */
+	size_t best = begin, i;
+	uint64_t sum = 0;
+
+	*score = 0;
+	for (i = begin; i + DMER <= end; i++) {
+		const unsigned h = dmer_hash(c->data + i);
+
+		if (!c->active[h]++)
+			sum += c->freq[h];
+
+		// Drop the d-mer that left the window
+		if (i - begin >= window) {
+			const unsigned old = dmer_hash(c->data + i - window);
+
+			if (!--c->active[old])
+				sum -= c->freq[old];
+		}
+
+		if (sum > *score) {
+			*score = sum;
+			best = i - begin >= window ? i - window + 1 : begin;
+		}
+	}
+
+	// Clear the window counts for the next epoch
+	for (i = begin; i + DMER <= end; i++)
+		c->active[dmer_hash(c->data + i)] = 0;
+
+	return best;
+}
+
+/* Fill dict with up to size bytes trained on the samples. Returns the
+ * bytes used, which may be less when the samples are small, or 0 on
+ * failure. */
+size_t lzb_train_dict(const uint8_t *const *samples, const size_t *sizes,
+		      unsigned nsamples, uint8_t *dict, size_t size) {
+	struct corpus c = { 0 };
+	size_t i, pos = size;
+	unsigned s;
+
+	for (s = 0; s < nsamples; s++)
+		c.len += sizes[s];
+	if (size > LZB_DICT_MAX || size < DMER || c.len < DMER)
+		return 0;
+
+	c.data = malloc(c.len);
+	c.freq = calloc(1u << FREQ_BITS, sizeof(*c.freq));
+	c.active = calloc(1u << FREQ_BITS, sizeof(*c.active));
+	uint32_t *const seen = calloc(1u << FREQ_BITS, sizeof(*seen));
+	if (!c.data || !c.freq || !c.active || !seen) {
+		pos = 0;
+		goto out;
+	}
+
+	// Count each d-mer once per sample
+	size_t at = 0;
+	for (s = 0; s < nsamples; s++) {
+		memcpy(c.data + at, samples[s], sizes[s]);
+		for (i = 0; i + DMER <= sizes[s]; i++) {
+			const unsigned h = dmer_hash(c.data + at + i);
+
+			if (seen[h] != s + 1) {
+				seen[h] = s + 1;
+				c.freq[h]++;
+			}
+		}
+		at += sizes[s];
+	}
+
+	// D-mers only one sample has are no use to the others
+	for (i = 0; i < 1u << FREQ_BITS; i++)
+		if (c.freq[i] < 2)
+			c.freq[i] = 0;
+
+	const size_t seg = SEGMENT < size ? SEGMENT : size;
+	const size_t epochs = size / seg;
+	const size_t epoch = c.len / epochs > seg ? c.len / epochs : seg;
+	const size_t nepochs = (c.len + epoch - 1) / epoch;
+
+	// Go round the epochs until full or a whole round found nothing
+	for (size_t e = 0, idle = 0; pos > 0 && idle < nepochs;
+	     e = (e + 1) % nepochs) {
+		const size_t begin = e * epoch;
+		const size_t end = begin + epoch < c.len ? begin + epoch : c.len;
+		uint64_t score;
+
+		const size_t best = best_segment(&c, begin, end, seg, &score);
+		if (!score) {
+			idle++;
+			continue;
+		}
+		idle = 0;
+
+		size_t n = end - best < seg ? end - best : seg;
+		if (n > pos)
+			n = pos;
+		pos -= n;
+		memcpy(dict + pos, c.data + best, n);
+
+		// Taken d-mers score nothing in later segments
+		for (i = best; i + DMER <= best + n; i++)
+			c.freq[dmer_hash(c.data + i)] = 0;
+	}
+
+	// Move what was filled to the front
+	memmove(dict, dict + pos, size - pos);
+	pos = size - pos;
+
+out:
+	free(c.data);
+	free(c.freq);
+	free(c.active);
+	free(seen);
+	return pos;
+}
@@ -0,0 +1,43 @@
+/* Whole-file reads and writes for the packing tools. */
+
+#ifndef FILE_H
+#define FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// Returns a malloc'd copy of the file, or NULL
+static inline uint8_t *load_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *data = NULL;
+	long n;
+
+	if (!f)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) || (n = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) || !(data = malloc(n + 1)) ||
+	    fread(data, 1, n, f) != (size_t) n) {
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+	*len = n;
+	return data;
+}
+
+static inline int save_file(const char *path, const void *data, size_t len) {
+	FILE *f = fopen(path, "wb");
+
+	if (!f)
+		return -1;
+	if (fwrite(data, 1, len, f) != len) {
+		fclose(f);
+		return -1;
+	}
+	return fclose(f);
+}
+
+#endif
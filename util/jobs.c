@@ -0,0 +1,59 @@
+/* Thread pool for the packing tools, see jobs.h. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+struct jobs {
+	pthread_mutex_t lock;
+	unsigned next, count;
+	void (*fn)(void *ctx, unsigned i);
+	void *ctx;
+};
+
+static void *worker(void *arg) {
+	struct jobs *const j = arg;
+
+	while (1) {
+		pthread_mutex_lock(&j->lock);
+		const unsigned i = j->next++;
+		pthread_mutex_unlock(&j->lock);
+
+		if (i >= j->count)
+			return NULL;
+		j->fn(j->ctx, i);
+	}
+}
+
+void run_jobs(unsigned n, void (*fn)(void *ctx, unsigned i), void *ctx,
+	      unsigned nthreads) {
+	struct jobs j = { PTHREAD_MUTEX_INITIALIZER, 0, n, fn, ctx };
+	pthread_t tid[MAX_JOBS];
+	unsigned i;
+
+	if (nthreads > n)
+		nthreads = n;
+	if (nthreads > MAX_JOBS)
+		nthreads = MAX_JOBS;
+
+	// No threads for one job, so callers can nest
+	if (nthreads <= 1) {
+		for (i = 0; i < n; i++)
+			fn(ctx, i);
+		return;
+	}
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&tid[i], NULL, worker, &j))
+			abort();
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+}
+
+unsigned default_jobs(void) {
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n < 1 ? 1 : n > MAX_JOBS ? MAX_JOBS : n;
+}
@@ -0,0 +1,14 @@
+/* Work split over threads for the packing tools. Each thread takes the
+ * next index until all are done. Results go to per-index slots, so output
+ * never depends on the thread count. */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#define MAX_JOBS 64
+
+void run_jobs(unsigned n, void (*fn)(void *ctx, unsigned i), void *ctx,
+	      unsigned nthreads);
+unsigned default_jobs(void);
+
+#endif
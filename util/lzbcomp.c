@@ -0,0 +1,240 @@
+/* LZB compressor.
+ *
+ * Hash chains over 4-byte prefixes, limited to the block being coded
+ * since blocks decode independently, plus the dictionary in front of it
+ * when there is one. The level sets the chain depth, and from level 4 on
+ * a match is deferred by one byte when the next position has a longer
+ * one. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzbcomp.h"
+#include "jobs.h"
+#include "be.h"
+
+#define HASH_BITS 12
+#define NIL 0xFFFF
+
+static unsigned hash4(const uint8_t *p) {
+	return (get_be32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+struct chains {
+	uint16_t head[1 << HASH_BITS];
+	uint16_t prev[LZB_DICT_MAX + LZB_BLOCK];
+};
+
+static void insert(struct chains *c, const uint8_t *in, unsigned pos) {
+	const unsigned h = hash4(in + pos);
+
+	c->prev[pos] = c->head[h];
+	c->head[h] = pos;
+}
+
+static unsigned find(const struct chains *c, const uint8_t *in, unsigned len,
+		     unsigned pos, unsigned depth, unsigned *off) {
+	unsigned best = 0, cand = c->head[hash4(in + pos)];
+
+	while (cand != NIL && depth--) {
+		unsigned n = 0;
+
+		while (pos + n < len && in[cand + n] == in[pos + n])
+			n++;
+		if (n > best) {
+			best = n;
+			*off = pos - cand;
+			if (pos + n == len)
+				break;
+		}
+		cand = c->prev[cand];
+	}
+
+	/* The RSP copies matches under 8 bytes back one byte at a time. A run
+	 * with a short period matches as well a multiple of it further back,
+	 * which goes 8 bytes per step; too close to the block start, the run
+	 * is cut where the next match can reach that far. */
+	if (best && *off < 8) {
+		const unsigned far = (8 + *off - 1) / *off * *off;
+		unsigned n = 0;
+
+		if (far <= pos) {
+			while (pos + n < len && in[pos - far + n] == in[pos + n])
+				n++;
+			if (n == best)
+				*off = far;
+		} else if (best > far - pos && far - pos >= LZB_MIN_MATCH) {
+			best = far - pos;
+		}
+	}
+
+	return best >= LZB_MIN_MATCH ? best : 0;
+}
+
+static unsigned put_len(uint8_t *out, unsigned op, unsigned v) {
+	for (; v >= 255; v -= 255)
+		out[op++] = 255;
+	out[op++] = v;
+	return op;
+}
+
+static unsigned emit(uint8_t *out, unsigned op, const uint8_t *lits,
+		     unsigned nlit, unsigned mlen, unsigned off) {
+	const unsigned m = mlen ? mlen - LZB_MIN_MATCH : 0;
+
+	out[op++] = (nlit < 15 ? nlit : 15) << 4 | (m < 15 ? m : 15);
+	if (nlit >= 15)
+		op = put_len(out, op, nlit - 15);
+	memcpy(out + op, lits, nlit);
+	op += nlit;
+
+	if (mlen) {
+		put_be16(out + op, off);
+		op += 2;
+		if (m >= 15)
+			op = put_len(out, op, m - 15);
+	}
+	return op;
+}
+
+/* Code in[start, len) into out, with in[0, start) as history the decoder
+ * already has */
+static unsigned compress(const uint8_t *in, unsigned start, unsigned len,
+			 uint8_t *out, int level) {
+	uint8_t tmp[LZB_BLOCK + LZB_BLOCK / 255 + 16];
+	const unsigned depth = 1u << (level - 1), blen = len - start;
+	unsigned ip, anchor = start, op = 0;
+	static _Thread_local struct chains c;
+
+	memset(c.head, 0xFF, sizeof(c.head));
+	for (ip = 0; ip < start && ip + LZB_MIN_MATCH <= len; ip++)
+		insert(&c, in, ip);
+	ip = start;
+
+	while (ip + LZB_MIN_MATCH <= len) {
+		unsigned off = 0, mlen = find(&c, in, len, ip, depth, &off);
+
+		if (mlen && level >= 4 && ip + 1 + LZB_MIN_MATCH <= len) {
+			unsigned off2 = 0;
+
+			insert(&c, in, ip);
+			const unsigned next = find(&c, in, len, ip + 1, depth, &off2);
+			if (next > mlen) {
+				insert(&c, in, ++ip);
+				mlen = next;
+				off = off2;
+			}
+		} else if (!mlen) {
+			insert(&c, in, ip++);
+			continue;
+		} else {
+			insert(&c, in, ip);
+		}
+
+		op = emit(tmp, op, in + anchor, ip - anchor, mlen, off);
+		if (op > LZB_MAX_CSIZE)
+			goto raw;
+
+		// The match start is already in the chains
+		const unsigned end = ip + mlen;
+		for (ip++; ip < end; ip++)
+			if (ip + LZB_MIN_MATCH <= len)
+				insert(&c, in, ip);
+		anchor = ip;
+	}
+
+	if (anchor < len)
+		op = emit(tmp, op, in + anchor, len - anchor, 0, 0);
+
+	if (LZB_ALIGN8(op) >= LZB_ALIGN8(blen) || op > LZB_MAX_CSIZE) {
+raw:
+		memcpy(out, in + start, blen);
+		memset(out + blen, 0, LZB_ALIGN8(blen) - blen);
+		return LZB_ALIGN8(blen);
+	}
+
+	memcpy(out, tmp, op);
+	memset(out + op, 0, LZB_ALIGN8(op) - op);
+	return LZB_ALIGN8(op);
+}
+
+/* Code one block into out, which needs room for LZB_BLOCK bytes. Returns
+ * the stored size, padded to 8; blocks that do not shrink enough are
+ * stored raw. */
+unsigned lzb_compress_block(const uint8_t *in, unsigned len, uint8_t *out,
+			    int level) {
+	return compress(in, 0, len, out, level);
+}
+
+// Build a whole container; the result is malloc'd
+uint8_t *lzb_compress(const uint8_t *in, size_t len, int level,
+		      const struct lzb_info *info, size_t *outlen) {
+	return lzb_compress_dict(in, len, level, info, NULL, 0, 1, outlen);
+}
+
+struct blocks {
+	const uint8_t *in, *dict;
+	size_t len, dictlen;
+	int level;
+	uint8_t *coded;  /* LZB_BLOCK per block */
+	uint16_t *sizes; /* stored size per block */
+};
+
+static void block_job(void *ctx, unsigned i) {
+	static _Thread_local uint8_t buf[LZB_DICT_MAX + LZB_BLOCK];
+	const struct blocks *const b = ctx;
+	const unsigned bsize = LZB_BLOCK_SIZE(b->len, i);
+
+	if (b->dictlen)
+		memcpy(buf, b->dict, b->dictlen);
+	memcpy(buf + b->dictlen, b->in + (size_t) i * LZB_BLOCK, bsize);
+	b->sizes[i] = compress(buf, b->dictlen, b->dictlen + bsize,
+			       b->coded + (size_t) i * LZB_BLOCK, b->level);
+}
+
+/* The same against a dictionary, giving an LZB_DICT_MAGIC container that
+ * only the CPU decoder takes. Without one it is a plain container. Blocks
+ * are coded independently over up to threads threads, into the same
+ * output whatever their number. */
+uint8_t *lzb_compress_dict(const uint8_t *in, size_t len, int level,
+			   const struct lzb_info *info, const uint8_t *dict,
+			   size_t dictlen, unsigned threads, size_t *outlen) {
+	const uint32_t nblocks = (len + LZB_BLOCK - 1) / LZB_BLOCK;
+	const size_t data = LZB_DATA_OFFSET(nblocks);
+	struct blocks b = { in, dict, len, dictlen, level, NULL, NULL };
+	uint32_t i;
+
+	if (dictlen > LZB_DICT_MAX)
+		return NULL;
+
+	uint8_t *const out = calloc(1, data + (size_t) nblocks * LZB_BLOCK);
+	b.coded = malloc((size_t) nblocks * LZB_BLOCK + 1);
+	b.sizes = malloc(nblocks * sizeof(*b.sizes) + 1);
+	if (!out || !b.coded || !b.sizes) {
+		free(out);
+		free(b.coded);
+		free(b.sizes);
+		return NULL;
+	}
+
+	put_be32(out, dict ? LZB_DICT_MAGIC : LZB_MAGIC);
+	put_be32(out + 4, len);
+	put_be32(out + 8, nblocks);
+	put_be32(out + 12, dict ? lzb_dict_id(dict, dictlen) : info ? info->load : 0);
+	put_be32(out + 16, info ? info->entry : 0);
+	put_be32(out + 20, info ? info->memsz : 0);
+
+	run_jobs(nblocks, block_job, &b, threads);
+
+	size_t pos = data;
+	for (i = 0; i < nblocks; i++) {
+		put_be16(out + sizeof(struct lzb_hdr) + 2 * i, b.sizes[i]);
+		memcpy(out + pos, b.coded + (size_t) i * LZB_BLOCK, b.sizes[i]);
+		pos += b.sizes[i];
+	}
+
+	free(b.coded);
+	free(b.sizes);
+	*outlen = pos;
+	return out;
+}
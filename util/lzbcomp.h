@@ -0,0 +1,31 @@
+/* LZB compressor, see src/lzb.h for the format. */
+
+#ifndef LZBCOMP_H
+#define LZBCOMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lzb.h"
+
+#define LZB_MIN_LEVEL 1
+#define LZB_MAX_LEVEL 9
+
+/* Values for the container header; all zero for plain payloads */
+struct lzb_info {
+	uint32_t load, entry, memsz;
+};
+
+unsigned lzb_compress_block(const uint8_t *in, unsigned len, uint8_t *out,
+			    int level);
+uint8_t *lzb_compress(const uint8_t *in, size_t len, int level,
+		      const struct lzb_info *info, size_t *outlen);
+uint8_t *lzb_compress_dict(const uint8_t *in, size_t len, int level,
+			   const struct lzb_info *info, const uint8_t *dict,
+			   size_t dictlen, unsigned threads, size_t *outlen);
+
+/* Dictionary training over sample payloads, see dicttrain.c */
+size_t lzb_train_dict(const uint8_t *const *samples, const size_t *sizes,
+		      unsigned nsamples, uint8_t *dict, size_t size);
+
+#endif
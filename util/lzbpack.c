@@ -0,0 +1,271 @@
+/* LZB packer.
+ *
+ * c  compresses any payload, k compresses the loadable segment of a
+ *    vmlinux and fills in load address, entry and memory size for the
+ *    loader, d decodes with the reference decoder, and m runs the RSP
+ *    model over a container, checks it against the reference decoder
+ *    and prints its cycle estimate.
+ *
+ * Blocks are coded over -j threads, all cores by default; the output is
+ * the same for any count.
+ *
+ * t  trains a dictionary for small payloads on sample files; file:bytes
+ *    takes only the head of a file, such as the first disk blocks. c and
+ *    d with -D code against such a dictionary. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lzbcomp.h"
+#include "rspmodel.h"
+#include "jobs.h"
+#include "file.h"
+#include "be.h"
+
+#define PT_LOAD 1
+
+// The PT_LOAD of a big-endian ELF32. The loaders only read the first, so
+// -2 if there are more, -1 if there is none
+static int elf_segment(const uint8_t *elf, size_t len, struct lzb_info *info,
+		       uint32_t *off, uint32_t *filesz) {
+	uint32_t i;
+	int found = 0;
+
+	if (len < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 || elf[5] != 2)
+		return -1;
+
+	const uint32_t phoff = get_be32(elf + 28);
+	const unsigned phentsize = get_be16(elf + 42), phnum = get_be16(elf + 44);
+
+	for (i = 0; i < phnum; i++) {
+		const uint8_t *const ph = elf + phoff + i * phentsize;
+
+		if (phoff + (i + 1) * phentsize > len)
+			return -1;
+		if (get_be32(ph) != PT_LOAD)
+			continue;
+		if (found)
+			return -2;
+
+		*off = get_be32(ph + 4);
+		*filesz = get_be32(ph + 16);
+		info->load = get_be32(ph + 12);
+		info->memsz = get_be32(ph + 20);
+		info->entry = get_be32(elf + 24);
+		if (*off + (uint64_t) *filesz > len)
+			return -1;
+		found = 1;
+	}
+
+	return found ? 0 : -1;
+}
+
+static int model(const uint8_t *in, size_t len) {
+	struct rsp_stats st;
+
+	if (len < sizeof(struct lzb_hdr) || get_be32(in) != LZB_MAGIC) {
+		puts("Not an LZB container");
+		return 1;
+	}
+
+	const uint32_t usize = get_be32(in + 4);
+	uint8_t *const ref = malloc(usize + 1);
+	uint8_t *const out = malloc(LZB_ALIGN8(usize) + 1);
+	if (!ref || !out)
+		abort();
+
+	if (lzb_decode(in, len, ref, usize)) {
+		puts("Reference decoder rejects the container");
+		return 1;
+	}
+
+	const char *err = rsp_model(in, len, out, LZB_ALIGN8(usize), &st, NULL);
+	if (err) {
+		printf("RSP model: %s after %u blocks\n", err, st.blocks);
+		return 1;
+	}
+	if (memcmp(ref, out, usize)) {
+		puts("RSP model output differs from the reference decoder");
+		return 1;
+	}
+
+	printf("%u bytes in %u blocks (%u raw), %u runs\n", usize, st.blocks,
+	       st.raw, st.runs);
+	printf("%llu RSP cycles, %llu in DMA, %.2f ms, %.1f MB/s\n",
+	       (unsigned long long) st.cycles, (unsigned long long) st.dma_cycles,
+	       st.cycles * 1000.0 / RSP_HZ,
+	       st.cycles ? usize / (st.cycles / (double) RSP_HZ) / 1e6 : 0.0);
+
+	free(ref);
+	free(out);
+	return 0;
+}
+
+static int train(const char *out, char *const *specs, unsigned n,
+		 size_t size) {
+	const uint8_t **const samples = calloc(n, sizeof(*samples));
+	size_t *const sizes = calloc(n, sizeof(*sizes));
+	uint8_t *const dict = malloc(size);
+	size_t total = 0;
+	unsigned i;
+
+	if (!samples || !sizes || !dict)
+		abort();
+
+	for (i = 0; i < n; i++) {
+		char *const colon = strrchr(specs[i], ':');
+		size_t head = 0;
+
+		if (colon) {
+			*colon = 0;
+			head = strtoul(colon + 1, NULL, 0);
+		}
+		if (!(samples[i] = load_file(specs[i], &sizes[i]))) {
+			printf("Can't read %s\n", specs[i]);
+			return 1;
+		}
+		if (head && head < sizes[i])
+			sizes[i] = head;
+		total += sizes[i];
+	}
+
+	const size_t got = lzb_train_dict(samples, sizes, n, dict, size);
+	if (!got) {
+		puts("Nothing in common between the samples to train on");
+		return 1;
+	}
+	fprintf(stderr, "%zu byte dictionary from %zu bytes in %u samples\n",
+		got, total, n);
+
+	if (save_file(out, dict, got)) {
+		printf("Can't write %s\n", out);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	struct lzb_info info = { 0 }, *ip = NULL;
+	const char *dictfile = NULL;
+	uint8_t *in, *out, *dict = NULL;
+	size_t len, outlen, dictlen = 0, dictsize = 4096;
+	unsigned threads = default_jobs();
+	int level = 6, opt;
+
+	if (argc < 2)
+		goto usage;
+	const char mode = argv[1][0];
+	optind = 2;
+
+	while ((opt = getopt(argc, argv, "l:D:s:j:")) != -1) {
+		switch (opt) {
+		case 'l':
+			level = atoi(optarg);
+			if (level < LZB_MIN_LEVEL || level > LZB_MAX_LEVEL)
+				goto usage;
+			break;
+		case 'D':
+			dictfile = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 1)
+				goto usage;
+			break;
+		case 's':
+			dictsize = strtoul(optarg, NULL, 0);
+			if (dictsize < 256 || dictsize > LZB_DICT_MAX)
+				goto usage;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (argv[1][1] || !strchr("ckdmt", mode) ||
+	    (mode == 't' ? argc - optind < 2
+			 : argc - optind != (mode == 'm' ? 1 : 2)) ||
+	    (dictfile && mode != 'c' && mode != 'd')) {
+usage:
+		printf("Usage: %s c|k [-l 1-9] [-j threads] in out\n", argv[0]);
+		printf("       %s c [-l 1-9] [-j threads] -D dict in out\n", argv[0]);
+		printf("       %s d [-D dict] in out\n", argv[0]);
+		printf("       %s m in\n", argv[0]);
+		printf("       %s t [-s 256-%u] dict sample[:bytes]...\n", argv[0],
+		       LZB_DICT_MAX);
+		return 1;
+	}
+
+	if (mode == 't')
+		return train(argv[optind], argv + optind + 1, argc - optind - 1,
+			     dictsize);
+
+	if (dictfile) {
+		if (!(dict = load_file(dictfile, &dictlen)) || dictlen > LZB_DICT_MAX) {
+			printf("Can't use %s as a dictionary\n", dictfile);
+			return 1;
+		}
+	}
+
+	if (!(in = load_file(argv[optind], &len))) {
+		printf("Can't read %s\n", argv[optind]);
+		return 1;
+	}
+
+	if (mode == 'm')
+		return model(in, len);
+
+	if (mode == 'd') {
+		if (len < sizeof(struct lzb_hdr) ||
+		    get_be32(in) != (dict ? LZB_DICT_MAGIC : LZB_MAGIC)) {
+			puts(dict ? "Not a dictionary coded LZB container"
+				  : "Not an LZB container");
+			return 1;
+		}
+		outlen = get_be32(in + 4);
+		if (!(out = malloc(outlen + 1)))
+			abort();
+		if (lzb_decode_dict(in, len, out, outlen, dict, dictlen)) {
+			puts(dict && get_be32(in + 12) != lzb_dict_id(dict, dictlen)
+				     ? "Container was coded against another dictionary"
+				     : "Corrupt container");
+			return 1;
+		}
+	} else {
+		const uint8_t *data = in;
+
+		if (mode == 'k') {
+			uint32_t off, filesz;
+
+			switch (elf_segment(in, len, &info, &off, &filesz)) {
+			case -1:
+				puts("Not a big-endian ELF32 kernel");
+				return 1;
+			case -2:
+				puts("More than one loadable segment");
+				return 1;
+			}
+			data = in + off;
+			len = filesz;
+			ip = &info;
+		}
+
+		if (!(out = lzb_compress_dict(data, len, level, ip, dict, dictlen,
+					      threads, &outlen)))
+			abort();
+		fprintf(stderr, "%zu -> %zu bytes\n", len, outlen);
+	}
+
+	if (save_file(argv[optind + 1], out, outlen)) {
+		printf("Can't write %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	free(in);
+	free(out);
+	free(dict);
+	return 0;
+}
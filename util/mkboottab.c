@@ -0,0 +1,52 @@
+/* Collect boot table records into the table placed below the size words.
+ * See src/boottab.h for the format. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "boottab.h"
+#include "be.h"
+
+int main(int argc, char **argv) {
+	static uint8_t tab[BOOTTAB_MAX];
+	unsigned size = sizeof(struct boottab_hdr);
+	int i;
+
+	if (argc < 2) {
+		printf("Usage: %s boottab.bin [record...]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 2; i < argc; i++) {
+		FILE *f = fopen(argv[i], "rb");
+		if (!f) {
+			printf("Can't open %s\n", argv[i]);
+			return 1;
+		}
+
+		const size_t len = fread(tab + size, 1, sizeof(tab) - size, f);
+		if (!feof(f) || len < 4 || 4u + get_be16(tab + size + 2) > len) {
+			printf("Bad or oversized record %s\n", argv[i]);
+			return 1;
+		}
+		fclose(f);
+
+		size += (len + 3) & ~3;
+		if (size > BOOTTAB_MAX) {
+			puts("Boot table full");
+			return 1;
+		}
+	}
+
+	put_be32(tab, BOOTTAB_MAGIC);
+	put_be16(tab + 4, BOOTTAB_VERSION);
+	put_be16(tab + 6, size);
+
+	FILE *f = fopen(argv[1], "wb");
+	if (!f || fwrite(tab, 1, size, f) != size)
+		abort();
+	fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,518 @@
+/* Build the read-ahead hint table for a disk image, see readahead.h.
+ *
+ * Walks the directory tree of a squashfs (gzip, xz or uncompressed
+ * metadata) or an erofs image (uncompressed files) and takes the files
+ * whose path matches one of the patterns, by default the shared
+ * libraries and init. Files below a minimum size gain nothing from a
+ * large DMA and are left out. Each file's data is one contiguous range of
+ * the image; the ranges are widened to the alignment, sorted and merged
+ * when they touch or lie closer than the gap. */
+
+#include <fnmatch.h>
+#include <lzma.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "readahead.h"
+#include "file.h"
+#include "be.h"
+
+#define MAX_PATTERNS 64
+#define MAX_DEPTH 32
+
+static const char *patterns[MAX_PATTERNS] = {
+	"/lib/*.so*", "/usr/lib/*.so*", "/lib/ld-*", "/bin/busybox",
+	"/sbin/init", "/init",
+};
+static unsigned npatterns = 6;
+
+static size_t min_size = 16384;
+
+static const uint8_t *img;
+static size_t img_len;
+
+struct range {
+	uint64_t start, end;
+};
+
+static struct range *ranges;
+static size_t nranges, ranges_cap;
+static unsigned nfiles;
+
+static uint16_t le16(const uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p) {
+	return le16(p) | (uint32_t) le16(p + 2) << 16;
+}
+
+static uint64_t le64(const uint8_t *p) {
+	return le32(p) | (uint64_t) le32(p + 4) << 32;
+}
+
+static void add_file(const char *path, uint64_t start, uint64_t len) {
+	unsigned i;
+
+	if (len < min_size)
+		return;
+	for (i = 0; i < npatterns; i++)
+		if (!fnmatch(patterns[i], path, FNM_PATHNAME))
+			break;
+	if (i == npatterns)
+		return;
+
+	if (start + len > img_len) {
+		printf("%s: data past the end of the image, skipped\n", path);
+		return;
+	}
+	if (nranges == ranges_cap) {
+		ranges_cap = ranges_cap ? ranges_cap * 2 : 256;
+		if (!(ranges = realloc(ranges, ranges_cap * sizeof(*ranges))))
+			abort();
+	}
+	ranges[nranges].start = start;
+	ranges[nranges++].end = start + len;
+	nfiles++;
+	printf("%-48s 0x%08llx %8llu\n", path, (unsigned long long) start,
+	       (unsigned long long) len);
+}
+
+static void join(char *out, const char *dir, const char *name, unsigned len) {
+	snprintf(out, 4096, "%s/%.*s", strcmp(dir, "/") ? dir : "", (int) len,
+		 name);
+}
+
+/* squashfs */
+
+#define SQ_MAGIC 0x73717368
+#define SQ_GZIP 1
+#define SQ_XZ 4
+#define SQ_NONE 0xFFFFFFFFFFFFFFFFull
+
+struct meta {
+	uint8_t *data;    /* the table's metadata blocks decompressed */
+	size_t len;
+	uint64_t *disk;   /* on-disk offset of each block, from the table */
+	size_t *at;       /* and where it starts in data */
+	size_t nblocks;
+};
+
+static unsigned sq_comp;
+static uint32_t sq_block_size;
+static struct meta sq_inodes, sq_dirs;
+
+static int sq_unpack(const uint8_t *in, size_t inlen, uint8_t *out,
+		     size_t *outlen) {
+	if (sq_comp == SQ_GZIP) {
+		uLongf n = *outlen;
+
+		if (uncompress(out, &n, in, inlen) != Z_OK)
+			return -1;
+		*outlen = n;
+		return 0;
+	}
+	if (sq_comp == SQ_XZ) {
+		uint64_t limit = UINT64_MAX;
+		size_t inpos = 0, outpos = 0;
+
+		if (lzma_stream_buffer_decode(&limit, 0, NULL, in, &inpos, inlen, out,
+					      &outpos, *outlen) != LZMA_OK)
+			return -1;
+		*outlen = outpos;
+		return 0;
+	}
+	return -1;
+}
+
+// Decompress the metadata blocks from start up to end
+static int sq_meta(uint64_t start, uint64_t end, struct meta *m) {
+	uint64_t pos = start;
+
+	memset(m, 0, sizeof(*m));
+	while (pos + 2 <= end && pos + 2 <= img_len) {
+		const unsigned hdr = le16(img + pos);
+		const unsigned clen = hdr & 0x7FFF;
+		size_t n = 8192;
+
+		if (pos + 2 + clen > img_len)
+			return -1;
+		if (!(m->data = realloc(m->data, m->len + 8192)) ||
+		    !(m->disk = realloc(m->disk, (m->nblocks + 1) * sizeof(*m->disk))) ||
+		    !(m->at = realloc(m->at, (m->nblocks + 1) * sizeof(*m->at))))
+			abort();
+
+		if (hdr & 0x8000) {
+			if (clen > 8192)
+				return -1;
+			memcpy(m->data + m->len, img + pos + 2, clen);
+			n = clen;
+		} else if (sq_unpack(img + pos + 2, clen, m->data + m->len, &n)) {
+			return -1;
+		}
+
+		m->disk[m->nblocks] = pos - start;
+		m->at[m->nblocks++] = m->len;
+		m->len += n;
+		pos += 2 + clen;
+	}
+	return 0;
+}
+
+// Position in the decompressed table of a block reference and offset
+static const uint8_t *sq_ref(const struct meta *m, uint64_t block,
+			     unsigned offset, size_t need) {
+	size_t i;
+
+	for (i = 0; i < m->nblocks; i++) {
+		if (m->disk[i] == block) {
+			const size_t at = m->at[i] + offset;
+			return at + need <= m->len ? m->data + at : NULL;
+		}
+	}
+	return NULL;
+}
+
+static int sq_walk(uint64_t ref, const char *path, unsigned depth);
+
+static void sq_dir(uint32_t block, unsigned offset, uint32_t size,
+		   const char *path, unsigned depth) {
+	char child[4096];
+
+	// The listing size counts "." and ".." as 3 bytes
+	if (size <= 3)
+		return;
+	size -= 3;
+
+	const uint8_t *p = sq_ref(&sq_dirs, block, offset, size);
+	if (!p) {
+		printf("%s: bad directory reference\n", path);
+		return;
+	}
+	const uint8_t *const end = p + size;
+
+	while (p + 12 <= end) {
+		unsigned count = le32(p) + 1;
+		const uint32_t start = le32(p + 4);
+
+		p += 12;
+		while (count-- && p + 8 <= end) {
+			const unsigned off = le16(p), namelen = le16(p + 6) + 1;
+
+			if (p + 8 + namelen > end)
+				return;
+			join(child, path, (const char *) p + 8, namelen);
+			sq_walk((uint64_t) start << 16 | off, child, depth + 1);
+			p += 8 + namelen;
+		}
+	}
+}
+
+static void sq_file(const uint8_t *sizes, uint64_t blocks_start,
+		    uint64_t file_size, uint32_t frag, const char *path) {
+	uint64_t n = file_size / sq_block_size, i, len = 0;
+
+	if (frag == 0xFFFFFFFF && file_size % sq_block_size)
+		n++;
+	if (sizes + n * 4 > sq_inodes.data + sq_inodes.len)
+		return;
+	for (i = 0; i < n; i++)
+		len += le32(sizes + i * 4) & 0xFFFFFF;
+	add_file(path, blocks_start, len);
+}
+
+static int sq_walk(uint64_t ref, const char *path, unsigned depth) {
+	const uint8_t *p = sq_ref(&sq_inodes, ref >> 16, ref & 0xFFFF, 16);
+
+	// Extended inodes are longer, up to the fields read below
+	if (p)
+		p = sq_ref(&sq_inodes, ref >> 16, ref & 0xFFFF,
+			   le16(p) == 8 ? 40 : le16(p) == 9 ? 56 : 32);
+	if (!p) {
+		printf("%s: bad inode reference\n", path);
+		return -1;
+	}
+	if (depth > MAX_DEPTH)
+		return 0;
+
+	switch (le16(p)) {
+	case 1: // directory
+		sq_dir(le32(p + 16), le16(p + 26), le16(p + 24), path, depth);
+		break;
+	case 8: // extended directory
+		sq_dir(le32(p + 24), le16(p + 34), le32(p + 20), path, depth);
+		break;
+	case 2: // file
+		sq_file(p + 32, le32(p + 16), le32(p + 28), le32(p + 20), path);
+		break;
+	case 9: // extended file
+		sq_file(p + 56, le64(p + 16), le64(p + 24), le32(p + 44), path);
+		break;
+	}
+	return 0;
+}
+
+static int squashfs(void) {
+	const uint8_t *const sb = img;
+	uint64_t tables[5], dir_end = img_len;
+	unsigned i;
+
+	if (img_len < 96 || le16(sb + 28) != 4) {
+		puts("Only squashfs 4.x is supported");
+		return -1;
+	}
+	sq_comp = le16(sb + 20);
+	sq_block_size = le32(sb + 12);
+	if (!sq_block_size) {
+		puts("Bad squashfs block size");
+		return -1;
+	}
+
+	const uint64_t inode_table = le64(sb + 64), dir_table = le64(sb + 72);
+
+	// The directory table ends where the next table starts
+	tables[0] = le64(sb + 48);
+	tables[1] = le64(sb + 56);
+	tables[2] = le64(sb + 80);
+	tables[3] = le64(sb + 88);
+	tables[4] = le64(sb + 40);
+	for (i = 0; i < 5; i++)
+		if (tables[i] != SQ_NONE && tables[i] > dir_table && tables[i] < dir_end)
+			dir_end = tables[i];
+
+	if (sq_meta(inode_table, dir_table, &sq_inodes) ||
+	    sq_meta(dir_table, dir_end, &sq_dirs)) {
+		printf("Can't read the squashfs metadata, compressor %u; gzip, xz or "
+		       "uncompressed metadata is needed\n", sq_comp);
+		return -1;
+	}
+
+	return sq_walk(le64(sb + 32), "/", 0);
+}
+
+/* erofs */
+
+#define EROFS_MAGIC 0xE0F5E1E2
+#define EROFS_SB 1024
+#define EROFS_FLAT_PLAIN 0
+#define EROFS_FLAT_INLINE 2
+
+static unsigned ero_blkbits;
+static uint64_t ero_meta;
+
+struct ero_inode {
+	uint64_t size;
+	uint32_t blkaddr;
+	unsigned layout, mode;
+	uint64_t inline_at; /* image offset of the inline tail */
+};
+
+static int ero_inode(uint64_t nid, struct ero_inode *in) {
+	const uint64_t at = ero_meta + nid * 32;
+
+	if (at + 32 > img_len)
+		return -1;
+
+	const uint8_t *const p = img + at;
+	const unsigned format = le16(p), xattrs = le16(p + 2);
+	const int extended = format & 1;
+
+	if (extended && at + 64 > img_len)
+		return -1;
+
+	in->layout = format >> 1 & 7;
+	in->mode = le16(p + 4);
+	in->size = extended ? le64(p + 8) : le32(p + 8);
+	in->blkaddr = le32(p + 16);
+	in->inline_at = at + (extended ? 64 : 32) + (xattrs ? 12 + (xattrs - 1) * 4 : 0);
+	return 0;
+}
+
+// Image offset of byte pos of a flat file, or 0 if it has none there
+static uint64_t ero_offset(const struct ero_inode *in, uint64_t pos) {
+	const uint64_t blksz = 1ull << ero_blkbits;
+
+	if (in->layout == EROFS_FLAT_INLINE && pos >= in->size / blksz * blksz)
+		return in->inline_at + pos % blksz;
+	return ((uint64_t) in->blkaddr << ero_blkbits) + pos;
+}
+
+static void ero_walk(uint64_t nid, const char *path, unsigned depth) {
+	const uint64_t blksz = 1ull << ero_blkbits;
+	struct ero_inode in;
+	char child[4096];
+	uint64_t b;
+
+	if (depth > MAX_DEPTH || ero_inode(nid, &in))
+		return;
+	if (in.layout != EROFS_FLAT_PLAIN && in.layout != EROFS_FLAT_INLINE)
+		return; // compressed or chunked, not one range
+
+	if ((in.mode & 0xF000) == 0x8000) {
+		// Only the full blocks are contiguous when the tail is inline
+		add_file(path, ero_offset(&in, 0),
+			 in.layout == EROFS_FLAT_INLINE ? in.size / blksz * blksz
+							: in.size);
+		return;
+	}
+	if ((in.mode & 0xF000) != 0x4000)
+		return;
+
+	for (b = 0; b < in.size; b += blksz) {
+		const uint64_t at = ero_offset(&in, b);
+		const uint64_t len = in.size - b < blksz ? in.size - b : blksz;
+		unsigned i;
+
+		if (at + len > img_len || len < 12)
+			return;
+
+		const uint8_t *const d = img + at;
+		const unsigned n = le16(d + 8) / 12;
+		for (i = 0; i < n && (i + 1) * 12 <= len; i++) {
+			const unsigned nameoff = le16(d + i * 12 + 8);
+			unsigned nameend = i + 1 < n ? le16(d + (i + 1) * 12 + 8) : len;
+
+			if (nameoff >= len || nameend > len || nameend <= nameoff)
+				return;
+			while (nameend > nameoff && !d[nameend - 1])
+				nameend--;
+
+			const char *const name = (const char *) d + nameoff;
+			const unsigned namelen = nameend - nameoff;
+			if ((namelen == 1 && name[0] == '.') ||
+			    (namelen == 2 && name[0] == '.' && name[1] == '.'))
+				continue;
+
+			join(child, path, name, namelen);
+			ero_walk(le64(d + i * 12), child, depth + 1);
+		}
+	}
+}
+
+static int erofs(void) {
+	const uint8_t *const sb = img + EROFS_SB;
+
+	ero_blkbits = sb[12];
+	if (ero_blkbits < 9 || ero_blkbits > 16) {
+		puts("Bad erofs block size");
+		return -1;
+	}
+	ero_meta = (uint64_t) le32(sb + 40) << ero_blkbits;
+	ero_walk(le16(sb + 14), "/", 0);
+	return 0;
+}
+
+static int by_start(const void *a, const void *b) {
+	const struct range *const x = a, *const y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+int main(int argc, char **argv) {
+	size_t align = 4096, gap = 0, i, n = 0;
+	int opt, user_patterns = 0;
+
+	while ((opt = getopt(argc, argv, "p:m:a:g:")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (!user_patterns)
+				npatterns = 0;
+			user_patterns = 1;
+			if (npatterns == MAX_PATTERNS)
+				goto usage;
+			patterns[npatterns++] = optarg;
+			break;
+		case 'm':
+			min_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			align = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gap = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (argc - optind != 2 || !align || (align & (align - 1))) {
+usage:
+		printf("Usage: %s [-p pattern]... [-m minsize] [-a align] [-g gap] "
+		       "disk.img readahead.bin\n", argv[0]);
+		printf("Patterns match whole paths, by default the libraries and init\n");
+		return 1;
+	}
+
+	uint8_t *const data = load_file(argv[optind], &img_len);
+	if (!data) {
+		printf("Can't read %s\n", argv[optind]);
+		return 1;
+	}
+	img = data;
+	if (img_len > UINT32_MAX) {
+		puts("Disk does not fit 32-bit offsets");
+		return 1;
+	}
+
+	if (img_len >= 4 && le32(img) == SQ_MAGIC) {
+		if (squashfs())
+			return 1;
+	} else if (img_len >= EROFS_SB + 128 && le32(img + EROFS_SB) == EROFS_MAGIC) {
+		if (erofs())
+			return 1;
+	} else {
+		puts("Neither squashfs nor erofs");
+		return 1;
+	}
+
+	// Widen to the alignment, then merge what touches or nearly does
+	for (i = 0; i < nranges; i++) {
+		ranges[i].start &= ~(uint64_t) (align - 1);
+		ranges[i].end = (ranges[i].end + align - 1) & ~(uint64_t) (align - 1);
+		if (ranges[i].end > img_len)
+			ranges[i].end = img_len;
+	}
+	qsort(ranges, nranges, sizeof(*ranges), by_start);
+	for (i = 0; i < nranges; i++) {
+		if (n && ranges[i].start <= ranges[n - 1].end + gap) {
+			if (ranges[i].end > ranges[n - 1].end)
+				ranges[n - 1].end = ranges[i].end;
+		} else {
+			ranges[n++] = ranges[i];
+		}
+	}
+
+	const size_t len = sizeof(struct ra_hdr) + n * sizeof(struct ra_extent);
+	uint8_t *const out = calloc(1, len);
+	uint64_t covered = 0;
+	if (!out)
+		abort();
+	put_be32(out, RA_MAGIC);
+	put_be32(out + 4, n);
+	put_be32(out + 8, align);
+	put_be32(out + 12, img_len);
+	for (i = 0; i < n; i++) {
+		uint8_t *const e = out + sizeof(struct ra_hdr) + i * sizeof(struct ra_extent);
+
+		put_be32(e, ranges[i].start);
+		put_be32(e + 4, ranges[i].end - ranges[i].start);
+		covered += ranges[i].end - ranges[i].start;
+	}
+
+	printf("%u files in %zu extents, %llu kb of %zu kb\n", nfiles, n,
+	       (unsigned long long) covered / 1024, img_len / 1024);
+
+	if (save_file(argv[optind + 1], out, len)) {
+		printf("Can't write %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	free(out);
+	free(data);
+	return 0;
+}
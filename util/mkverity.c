@@ -0,0 +1,209 @@
+/* Build a dm-verity hash tree for the disk image.
+ *
+ * Writes the disk padded to whole blocks followed by the hash tree, in
+ * the layout the kernel's verity target expects with the data and hash
+ * device being the same n64cart disk (format version 1, salt prepended,
+ * top level first), and a boot table record with the root hash and tree
+ * location for the loader to pass on. Hashing is spread over -j threads;
+ * the output is the same for any count. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "boottab.h"
+#include "sha256.h"
+#include "jobs.h"
+#include "rec.h"
+
+#define BLOCK 4096
+#define PER_BLOCK (BLOCK / SHA256_LEN)
+
+static uint8_t salt[32];
+static unsigned saltlen;
+
+static void hash_block(const uint8_t *data, uint8_t *out) {
+	struct sha256 s;
+
+	sha256_init(&s);
+	sha256_update(&s, salt, saltlen);
+	sha256_update(&s, data, BLOCK);
+	sha256_final(&s, out);
+}
+
+/* Hashing runs over threads in runs of blocks, each job writing only its
+ * own part of the output */
+#define RUN 256
+
+struct level {
+	const uint8_t *src;
+	uint8_t *dst;
+	uint32_t n;
+};
+
+static void level_job(void *ctx, unsigned j) {
+	const struct level *const l = ctx;
+	uint32_t b;
+
+	for (b = j * RUN; b < l->n && b < (j + 1) * RUN; b++)
+		hash_block(l->src + (size_t) b * BLOCK, l->dst + b * SHA256_LEN);
+}
+
+/* The default salt is a hash tree of the contents: one SHA-256 per
+ * SLICE, then one over those */
+#define SLICE (1 << 20)
+
+struct slices {
+	const uint8_t *data;
+	size_t len;
+	uint8_t *hashes;
+};
+
+static void slice_job(void *ctx, unsigned i) {
+	const struct slices *const s = ctx;
+	const size_t at = (size_t) i * SLICE;
+	struct sha256 h;
+
+	sha256_init(&h);
+	sha256_update(&h, s->data + at, s->len - at < SLICE ? s->len - at : SLICE);
+	sha256_final(&h, s->hashes + i * SHA256_LEN);
+}
+
+static int parse_salt(const char *hex) {
+	unsigned i;
+
+	if (!strcmp(hex, "-"))
+		return 0;
+	for (i = 0; hex[i * 2] && hex[i * 2 + 1]; i++) {
+		if (i >= sizeof(salt) || sscanf(hex + i * 2, "%2hhx", &salt[i]) != 1)
+			return -1;
+	}
+	saltlen = i;
+	return hex[i * 2] ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+	const char *salthex = NULL;
+	unsigned levels, i, threads = default_jobs();
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:j:")) != -1) {
+		switch (opt) {
+		case 's':
+			salthex = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 1)
+				goto usage;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc - optind != 3) {
+usage:
+		printf("Usage: %s [-s salt|-] [-j threads] disk.img verity.img "
+		       "verity.rec\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		puts("Can't open disk");
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	rewind(f);
+
+	const uint32_t data_blocks = (size + BLOCK - 1) / BLOCK;
+	if (!data_blocks) {
+		puts("Empty disk");
+		return 1;
+	}
+
+	// Blocks per level, leaves first, and where each level starts
+	uint32_t count[8], start[8], hash_blocks = 0;
+	for (levels = 0; levels < 8 && (data_blocks - 1) >> (7 * levels); levels++)
+		count[levels] = (data_blocks + (1u << (7 * (levels + 1))) - 1) >>
+			(7 * (levels + 1));
+	for (i = levels; i-- > 0;) {
+		start[i] = hash_blocks;
+		hash_blocks += count[i];
+	}
+
+	uint8_t *const img = calloc(data_blocks + hash_blocks, BLOCK);
+	if (!img || fread(img, 1, size, f) != (size_t) size)
+		abort();
+	fclose(f);
+
+	// Reproducible by default: the salt is derived from the contents
+	if (salthex) {
+		if (parse_salt(salthex)) {
+			puts("Bad salt");
+			return 1;
+		}
+	} else {
+		const size_t len = (size_t) data_blocks * BLOCK;
+		const unsigned n = (len + SLICE - 1) / SLICE;
+		struct slices sl = { img, len, malloc(n * SHA256_LEN) };
+		struct sha256 s;
+
+		if (!sl.hashes)
+			abort();
+		run_jobs(n, slice_job, &sl, threads);
+
+		sha256_init(&s);
+		sha256_update(&s, sl.hashes, n * SHA256_LEN);
+		sha256_final(&s, salt);
+		saltlen = sizeof(salt);
+		free(sl.hashes);
+	}
+
+	uint8_t *const tree = img + (size_t) data_blocks * BLOCK;
+	uint8_t root[SHA256_LEN];
+
+	if (!levels) {
+		hash_block(img, root);
+	} else {
+		const uint8_t *src = img;
+		uint32_t n = data_blocks;
+
+		for (i = 0; i < levels; i++) {
+			struct level l = { src, tree + (size_t) start[i] * BLOCK, n };
+
+			run_jobs((n + RUN - 1) / RUN, level_job, &l, threads);
+			src = l.dst;
+			n = count[i];
+		}
+		hash_block(tree + (size_t) start[levels - 1] * BLOCK, root);
+	}
+
+	f = fopen(argv[optind + 1], "wb");
+	if (!f || fwrite(img, BLOCK, data_blocks + hash_blocks, f) !=
+	    data_blocks + hash_blocks)
+		abort();
+	fclose(f);
+
+	uint8_t rec[sizeof(struct bt_verity)] = { 0 };
+	put_be32(rec, data_blocks);
+	put_be32(rec + 4, data_blocks);
+	put_be16(rec + 8, BLOCK);
+	rec[10] = saltlen;
+	memcpy(rec + 12, root, SHA256_LEN);
+	memcpy(rec + 44, salt, saltlen);
+
+	if (write_rec(argv[optind + 2], BT_VERITY, rec, sizeof(rec))) {
+		puts("Can't write record");
+		return 1;
+	}
+
+	for (i = 0; i < SHA256_LEN; i++)
+		printf("%02x", root[i]);
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,279 @@
+/* Predict the loader's RAM map at handoff from a packed ROM.
+ *
+ * Works out the regions the loader prints before jumping to the kernel,
+ * see src/memmap.h: the loader image, from its ELF (stage 1 with
+ * TWOSTAGE=1), and its heap with the console framebuffers, the staging
+ * arena as the loader will fill it for this ROM's kernel and small
+ * payloads, the stack, the kernel at its load address with its bss, and
+ * the resident block. Fails when the kernel would land on the loader or
+ * its buffers, or when less than the floor is left free at handoff, for
+ * the smallest console the ROM is meant to boot on. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "boottab.h"
+#include "lzb.h"
+#include "memmap.h"
+#include "resident.h"
+#include "telemetry.h"
+#include "file.h"
+#include "be.h"
+
+#define KERNEL_OFF 0x101000
+#define KHDR_LEN 256
+
+/* libdragon's console_init: two 320x240 32-bit framebuffers and the
+ * text buffer, with malloc overhead */
+#define CONSOLE_HEAP (2 * 320 * 240 * 4 + 8192)
+
+struct region {
+	uint32_t start, end;
+	const char *what;
+	int kind;
+};
+
+static struct region map[MM_MAX];
+static unsigned nregions;
+
+static void add(uint32_t start, uint32_t len, const char *what, int kind) {
+	unsigned i;
+
+	if (!len || nregions >= MM_MAX)
+		return;
+
+	start &= 0x1FFFFFFF;
+	for (i = nregions++; i && map[i - 1].start > start; i--)
+		map[i] = map[i - 1];
+	map[i].start = start;
+	map[i].end = start + len;
+	map[i].what = what;
+	map[i].kind = kind;
+}
+
+// As in src/memmap.c
+static uint32_t covered(unsigned mask, uint32_t memsize) {
+	uint32_t total = 0, reach = 0;
+	unsigned i;
+
+	for (i = 0; i < nregions; i++) {
+		if (!(mask & 1 << map[i].kind))
+			continue;
+		const uint32_t s = map[i].start > reach ? map[i].start : reach;
+		const uint32_t e = map[i].end < memsize ? map[i].end : memsize;
+		if (e > s)
+			total += e - s;
+		if (map[i].end > reach)
+			reach = map[i].end;
+	}
+	return total;
+}
+
+static uint32_t align16(uint32_t v) {
+	return (v + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static int parse_size(const char *s, uint32_t *out) {
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (end == s)
+		return -1;
+	if (*end == 'K' || *end == 'k')
+		v <<= 10, end++;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20, end++;
+	*out = v;
+	return *end ? -1 : 0;
+}
+
+static const uint8_t *payload(const uint8_t *rom, size_t len, unsigned id,
+			      uint32_t *size) {
+	const uint8_t *const bt = rom + BOOTTAB_TOOL_OFFSET + 0x1000;
+	unsigned off = sizeof(struct boottab_hdr), i;
+
+	if (len < KERNEL_OFF || get_be32(bt) != BOOTTAB_MAGIC)
+		return NULL;
+
+	const unsigned btsize = get_be16(bt + 6);
+	while (off + sizeof(struct boottab_rec) <= btsize && btsize <= BOOTTAB_MAX) {
+		const unsigned tag = get_be16(bt + off), rlen = get_be16(bt + off + 2);
+		const uint8_t *const body = bt + off + sizeof(struct boottab_rec);
+
+		for (i = 0; tag == BT_LAYOUT && i < rlen / sizeof(struct bt_payload);
+		     i++) {
+			const uint8_t *const p = body + i * sizeof(struct bt_payload);
+			if (get_be16(p) != id || get_be32(p + 4) + get_be32(p + 8) > len)
+				continue;
+			*size = get_be32(p + 8);
+			return rom + get_be32(p + 4);
+		}
+		off += sizeof(struct boottab_rec) + ((rlen + 3) & ~3);
+	}
+	return NULL;
+}
+
+// Physical range the loader ELF loads to
+static int loader_span(const char *path, uint32_t *start, uint32_t *end) {
+	size_t len;
+	unsigned i;
+
+	uint8_t *const elf = load_file(path, &len);
+	if (!elf || len < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 ||
+	    elf[5] != 2)
+		return -1;
+
+	const uint32_t phoff = get_be32(elf + 28);
+	const unsigned phentsize = get_be16(elf + 42), phnum = get_be16(elf + 44);
+	*start = UINT32_MAX;
+	*end = 0;
+	for (i = 0; i < phnum && phoff + (i + 1) * phentsize <= len; i++) {
+		const uint8_t *const ph = elf + phoff + i * phentsize;
+		const uint32_t s = get_be32(ph + 8) & 0x1FFFFFFF;
+
+		if (get_be32(ph) != 1)
+			continue;
+		if (s < *start)
+			*start = s;
+		if (s + get_be32(ph + 20) > *end)
+			*end = s + get_be32(ph + 20);
+	}
+	free(elf);
+	return *end ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+	static const char *const kinds[] = { "", " [kernel]", " [kept]" };
+	uint32_t memsize = 4 << 20, floor = 0, heap = CONSOLE_HEAP;
+	uint32_t lstart, lend, paddr, memsz, size;
+	size_t len;
+	unsigned i;
+	int opt, bad = 0;
+
+	while ((opt = getopt(argc, argv, "m:f:c:")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (parse_size(optarg, &memsize))
+				goto usage;
+			break;
+		case 'f':
+			if (parse_size(optarg, &floor))
+				goto usage;
+			break;
+		case 'c':
+			if (parse_size(optarg, &heap))
+				goto usage;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (argc - optind != 2) {
+usage:
+		printf("Usage: %s [-m 4M] [-f floor] [-c heap] loader.elf rom.z64\n",
+		       argv[0]);
+		return 1;
+	}
+
+	if (loader_span(argv[optind], &lstart, &lend)) {
+		printf("Can't read the loader ELF %s\n", argv[optind]);
+		return 1;
+	}
+	uint8_t *const rom = load_file(argv[optind + 1], &len);
+	if (!rom || len < KERNEL_OFF) {
+		printf("Can't read %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	// The kernel header, where the loader looks for it
+	const uint8_t *k = payload(rom, len, PL_KERNEL, &size);
+	if (!k) {
+		k = rom + KERNEL_OFF;
+		size = len - KERNEL_OFF;
+	}
+	if (size < KHDR_LEN) {
+		puts("No kernel header");
+		return 1;
+	}
+
+	const uint32_t limit = (memsize - ARENA_STACK) & ~(ARENA_ALIGN - 1);
+	uint32_t staging = align16(RESIDENT_SIZE) + align16(64) + align16(256) +
+			   align16(sizeof(struct telem_log));
+
+	if (get_be32(k) == LZB_MAGIC) {
+		paddr = get_be32(k + 12);
+		memsz = get_be32(k + 20);
+		// RSP decoder parameters, block table and two staging buffers
+		staging += align16(16 + 2 * LZB_BATCH) +
+			   align16(2 * get_be32(k + 8) + 2) +
+			   2 * align16(LZB_BATCH * LZB_BLOCK);
+	} else if (!memcmp(k, "\177ELF", 4)) {
+		const uint32_t phoff = get_be32(k + 28);
+		for (i = phoff; i + 32 <= KHDR_LEN && get_be32(k + i) != 1; i += 32)
+			;
+		if (i + 32 > KHDR_LEN) {
+			puts("No loadable kernel segment in the header");
+			return 1;
+		}
+		paddr = get_be32(k + i + 12);
+		memsz = get_be32(k + i + 20);
+	} else {
+		puts("Kernel is neither ELF nor LZB");
+		return 1;
+	}
+
+	// The command line, decoded against the dictionary if need be
+	const uint8_t *const c = payload(rom, len, PL_CMDLINE, &size);
+	if (c) {
+		staging += align16(LZB_ALIGN8(size));
+		if (size >= sizeof(struct lzb_hdr) && get_be32(c) == LZB_DICT_MAGIC) {
+			staging += align16(get_be32(c + 4));
+			if (payload(rom, len, PL_DICT, &size))
+				staging += align16(LZB_ALIGN8(size));
+		}
+	}
+
+	add(lstart, lend - lstart, "loader", MM_LOADER);
+	add(lend, heap, "heap, console", MM_LOADER);
+	add(limit - staging, staging, "staging", MM_LOADER);
+	add(limit, memsize - limit, "stack", MM_LOADER);
+	add(paddr, memsz, "kernel", MM_KERNEL);
+	add(limit - RESIDENT_SIZE, RESIDENT_SIZE, "resident", MM_KEEP);
+
+	printf("RAM map of %u kb:\n", memsize / 1024);
+	for (i = 0; i < nregions; i++)
+		printf("%08x-%08x %5u kb %s%s\n", map[i].start, map[i].end - 1,
+		       (map[i].end - map[i].start) / 1024, map[i].what,
+		       kinds[map[i].kind]);
+
+	const uint32_t left = memsize - covered(1 << MM_LOADER | 1 << MM_KERNEL |
+						1 << MM_KEEP, memsize);
+	printf("Free at handoff: %u kb, left to the kernel: %u kb\n", left / 1024,
+	       (memsize - covered(1 << MM_KERNEL | 1 << MM_KEEP, memsize)) / 1024);
+
+	paddr &= 0x1FFFFFFF;
+	if (paddr + memsz > limit - staging) {
+		puts("The kernel runs into the loader's buffers");
+		bad = 1;
+	}
+	if (paddr < lend + heap && paddr + memsz > lstart) {
+		puts("The kernel overlaps the loader or its heap");
+		bad = 1;
+	}
+	if (lend + heap > limit - staging) {
+		puts("The loader's heap runs into its buffers");
+		bad = 1;
+	}
+	if (left < floor) {
+		printf("Less than the floor of %u kb free\n", floor / 1024);
+		bad = 1;
+	}
+
+	free(rom);
+	return bad;
+}
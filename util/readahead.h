@@ -0,0 +1,32 @@
+/* Read-ahead hint table for the n64cart block driver, built by
+ * mkreadahead and passed on by the loader as n64cart.readahead and
+ * n64cart.readaheadsize.
+ *
+ * It lists the byte ranges of the disk holding files that are read from
+ * start to end early in boot, such as the libraries in the boot path, so
+ * that the driver can fetch a whole range with one large PI DMA on the
+ * first read into it instead of page by page. Big-endian: the header,
+ * then the extents sorted by offset and not overlapping. Offsets and
+ * sizes are multiples of align, except that the last extent may end at
+ * the disk end. */
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <stdint.h>
+
+#define RA_MAGIC 0x52414831 /* "RAH1" */
+
+struct ra_hdr {
+	uint32_t magic;
+	uint32_t count;     /* extents */
+	uint32_t align;     /* bytes */
+	uint32_t disk_size; /* bytes of the image it was built for */
+};
+
+struct ra_extent {
+	uint32_t offset; /* from the start of the disk */
+	uint32_t size;
+};
+
+#endif
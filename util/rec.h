@@ -0,0 +1,32 @@
+/* Writing boot table records, see src/boottab.h. Each packing tool emits
+ * its record as a small file that mkboottab collects into the table. */
+
+#ifndef REC_H
+#define REC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "be.h"
+
+static inline int write_rec(const char *path, unsigned tag, const void *body,
+			    unsigned len) {
+	static const uint8_t zero[4];
+	uint8_t hdr[4];
+
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return -1;
+
+	put_be16(hdr, tag);
+	put_be16(hdr + 2, len);
+	if (fwrite(hdr, 4, 1, f) != 1 || fwrite(body, 1, len, f) != len ||
+	    fwrite(zero, 1, -len & 3, f) != (-len & 3)) {
+		fclose(f);
+		return -1;
+	}
+
+	return fclose(f);
+}
+
+#endif
@@ -0,0 +1,499 @@
+/* Audit packed ROM images in bulk.
+ *
+ * Checks, per image: the big-endian z64 header and its CRC against the
+ * IPL3 the image carries, the boot table if there is one, the disk and
+ * kernel size words, the kernel header (ELF32 or LZB) where the loader
+ * will look for it, and that the kernel and disk lie within the file.
+ * Plain images are mmapped; .gz ones are inflated as a stream, keeping
+ * only the first megabyte or so that the checks need, without temp
+ * files. Images are spread over worker threads so that the disks, not
+ * one checksum at a time, set the pace. Results are printed as a JSON
+ * array in argument order; the exit status tells whether all passed. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "boottab.h"
+#include "lzb.h"
+#include "be.h"
+
+#define ROM_MAGIC 0x80371240
+#define IPL3_START 0x40
+#define CRC_START 0x1000
+#define CRC_END 0x101000
+#define BOOTTAB_OFF 0x100000
+#define DISKSIZE_OFF 0x100FF8
+#define KERNELSIZE_OFF 0x100FFC
+#define KERNEL_OFF 0x101000
+#define KHDR_LEN 256
+
+/* Enough of the start of the image for everything but a kernel placed
+ * elsewhere by a layout */
+#define HEAD_LEN (KERNEL_OFF + KHDR_LEN)
+
+#define MAX_ERRORS 8
+
+struct image {
+	const uint8_t *head; /* first headlen bytes */
+	size_t headlen;
+	uint64_t size;
+	uint64_t khdr_at;   /* wanted kernel header offset, set by the checks */
+	uint8_t khdr[KHDR_LEN];
+	size_t khdr_len;    /* bytes of it found */
+};
+
+struct result {
+	const char *path;
+	uint64_t size;
+	unsigned cic;
+	uint32_t kernel_size, disk_size;
+	uint64_t kernel_at, disk_at;
+	const char *kernel_kind;
+	unsigned nerrors, nwarnings;
+	char errors[MAX_ERRORS][96];
+	char warnings[MAX_ERRORS][96];
+};
+
+static struct result *results;
+static char **paths;
+static unsigned npaths;
+static atomic_uint next_path;
+
+static void fail(struct result *r, const char *fmt, ...) {
+	va_list ap;
+
+	if (r->nerrors >= MAX_ERRORS)
+		return;
+	va_start(ap, fmt);
+	vsnprintf(r->errors[r->nerrors++], sizeof(r->errors[0]), fmt, ap);
+	va_end(ap);
+}
+
+// Noted in the report, but the image still passes
+static void warn(struct result *r, const char *fmt, ...) {
+	va_list ap;
+
+	if (r->nwarnings >= MAX_ERRORS)
+		return;
+	va_start(ap, fmt);
+	vsnprintf(r->warnings[r->nwarnings++], sizeof(r->warnings[0]), fmt, ap);
+	va_end(ap);
+}
+
+/* CIC seeds, told apart by the CRC32 of the IPL3 the image carries, as
+ * chksum64 and n64crc do */
+static const struct {
+	uint32_t ipl3_crc;
+	unsigned cic;
+	uint32_t seed;
+} cics[] = {
+	{ 0x6170A4A1, 6101, 0xF8CA4DDC }, { 0x90BB6CB5, 6102, 0xF8CA4DDC },
+	{ 0x0B050EE0, 6103, 0xA3886759 }, { 0x98BC2C86, 6105, 0xDF26F436 },
+	{ 0xACC8580A, 6106, 0x1FEA617A },
+};
+
+static uint32_t rol(uint32_t v, unsigned n) {
+	return n ? v << n | v >> (32 - n) : v;
+}
+
+static void rom_crc(const uint8_t *rom, unsigned cic, uint32_t seed,
+		    uint32_t crc[2]) {
+	uint32_t t1 = seed, t2 = seed, t3 = seed, t4 = seed, t5 = seed, t6 = seed;
+	uint32_t i;
+
+	for (i = CRC_START; i < CRC_END; i += 4) {
+		const uint32_t d = get_be32(rom + i);
+		const uint32_t r = rol(d, d & 31);
+
+		if (t6 + d < t6)
+			t4++;
+		t6 += d;
+		t3 ^= d;
+		t5 += r;
+		t2 ^= t2 > d ? r : t6 ^ d;
+		t1 += cic == 6105 ? get_be32(rom + 0x750 + (i & 0xFF)) ^ d : t5 ^ d;
+	}
+
+	if (cic == 6103) {
+		crc[0] = (t6 ^ t4) + t3;
+		crc[1] = (t5 ^ t2) + t1;
+	} else if (cic == 6106) {
+		crc[0] = t6 * t4 + t3;
+		crc[1] = t5 * t2 + t1;
+	} else {
+		crc[0] = t6 ^ t4 ^ t3;
+		crc[1] = t5 ^ t2 ^ t1;
+	}
+}
+
+static void check_boottab(const uint8_t *bt, struct result *r) {
+	const unsigned size = get_be16(bt + 6);
+	unsigned off = sizeof(struct boottab_hdr), i;
+
+	if (get_be16(bt + 4) != BOOTTAB_VERSION || size > BOOTTAB_MAX ||
+	    size < off) {
+		fail(r, "bad boot table header");
+		return;
+	}
+
+	while (off + sizeof(struct boottab_rec) <= size) {
+		const unsigned tag = get_be16(bt + off), len = get_be16(bt + off + 2);
+		const uint8_t *const body = bt + off + sizeof(struct boottab_rec);
+
+		if (off + sizeof(struct boottab_rec) + len > size) {
+			fail(r, "boot table record %u overruns the table", tag);
+			return;
+		}
+
+		for (i = 0; tag == BT_LAYOUT && i < len / sizeof(struct bt_payload);
+		     i++) {
+			const uint8_t *const p = body + i * sizeof(struct bt_payload);
+
+			if (get_be16(p + 2) & PL_F_MAPPED &&
+			    (get_be32(p + 4) % PL_MAP_ALIGN ||
+			     get_be32(p + 4) + get_be32(p + 8) > PL_MAP_LIMIT))
+				fail(r, "mapped payload %u at 0x%x is not page aligned "
+				     "in the cart window", get_be16(p), get_be32(p + 4));
+			if (get_be16(p) == PL_KERNEL) {
+				r->kernel_at = get_be32(p + 4);
+				r->kernel_size = get_be32(p + 8);
+			} else if (get_be16(p) == PL_DISK) {
+				r->disk_at = get_be32(p + 4);
+				r->disk_size = get_be32(p + 8);
+			}
+		}
+		off += sizeof(struct boottab_rec) + ((len + 3) & ~3);
+	}
+}
+
+// Everything that needs only the head; sets where the kernel header is
+static void check_head(struct image *im, struct result *r) {
+	const uint8_t *const rom = im->head;
+	uint32_t crc[2];
+	unsigned i;
+
+	if (im->headlen < HEAD_LEN) {
+		fail(r, "image is %zu bytes, too short for a kernel at 1 MB",
+		     im->headlen);
+		return;
+	}
+
+	if (get_be32(rom) != ROM_MAGIC) {
+		if (get_be32(rom) == 0x37804012 || get_be32(rom) == 0x40123780)
+			fail(r, "byte-swapped image, not z64");
+		else
+			fail(r, "bad header magic 0x%08x", get_be32(rom));
+		return;
+	}
+
+	const uint32_t ipl3 = crc32(0, rom + IPL3_START, CRC_START - IPL3_START);
+	r->cic = 6102;
+	uint32_t seed = cics[1].seed;
+	for (i = 0; i < sizeof(cics) / sizeof(cics[0]); i++) {
+		if (cics[i].ipl3_crc == ipl3) {
+			r->cic = cics[i].cic;
+			seed = cics[i].seed;
+			break;
+		}
+	}
+	if (i == sizeof(cics) / sizeof(cics[0]))
+		warn(r, "unknown IPL3 0x%08x, checked as 6102", ipl3);
+
+	rom_crc(rom, r->cic, seed, crc);
+	if (crc[0] != get_be32(rom + 0x10) || crc[1] != get_be32(rom + 0x14))
+		fail(r, "header CRC %08x %08x, expected %08x %08x",
+		     get_be32(rom + 0x10), get_be32(rom + 0x14), crc[0], crc[1]);
+
+	r->disk_size = get_be32(rom + DISKSIZE_OFF);
+	r->kernel_size = get_be32(rom + KERNELSIZE_OFF);
+	r->kernel_at = KERNEL_OFF;
+	r->disk_at = KERNEL_OFF + ((r->kernel_size + 4095ull) & ~4095ull);
+
+	// A layout record moves the payloads, as in the loader
+	if (get_be32(rom + BOOTTAB_OFF) == BOOTTAB_MAGIC)
+		check_boottab(rom + BOOTTAB_OFF, r);
+
+	if (!r->kernel_size)
+		fail(r, "no kernel size");
+	im->khdr_at = r->kernel_at;
+}
+
+// What needs the kernel header and the final size
+static void check_tail(const struct image *im, struct result *r) {
+	const uint8_t *const k = im->khdr;
+
+	r->size = im->size;
+	if (im->headlen < HEAD_LEN || get_be32(im->head) != ROM_MAGIC)
+		return;
+
+	if (r->kernel_at + r->kernel_size > im->size)
+		fail(r, "kernel at 0x%llx+%u runs past the end of the file",
+		     (unsigned long long) r->kernel_at, r->kernel_size);
+	if (r->disk_at + r->disk_size > im->size)
+		fail(r, "disk at 0x%llx+%u runs past the end of the file",
+		     (unsigned long long) r->disk_at, r->disk_size);
+	if (r->disk_size && r->disk_at < r->kernel_at + r->kernel_size &&
+	    r->kernel_at < r->disk_at + r->disk_size)
+		fail(r, "kernel and disk overlap");
+
+	if (im->khdr_len < 52) {
+		fail(r, "no kernel header at 0x%llx", (unsigned long long) im->khdr_at);
+		return;
+	}
+
+	if (get_be32(k) == LZB_MAGIC) {
+		r->kernel_kind = "lzb";
+		const uint32_t usize = get_be32(k + 4), nblocks = get_be32(k + 8);
+		if (nblocks != (usize + LZB_BLOCK - 1) / LZB_BLOCK)
+			fail(r, "LZB kernel block count %u for %u bytes", nblocks, usize);
+		if (get_be32(k + 20) < usize)
+			fail(r, "LZB kernel memsz below its size");
+		return;
+	}
+
+	if (memcmp(k, "\177ELF", 4)) {
+		r->kernel_kind = "unknown";
+		fail(r, "kernel is neither ELF nor LZB");
+		return;
+	}
+
+	r->kernel_kind = "elf";
+	if (k[4] != 1 || k[5] != 2) {
+		fail(r, "kernel is not a big-endian ELF32");
+		return;
+	}
+
+	// The loader only reads the first 256 bytes for program headers
+	const uint32_t phoff = get_be32(k + 28);
+	const unsigned phentsize = get_be16(k + 42), phnum = get_be16(k + 44);
+	unsigned i;
+
+	for (i = 0; i < phnum; i++) {
+		const uint32_t at = phoff + i * phentsize;
+
+		if (phentsize < 32 || at + 32 > KHDR_LEN) {
+			fail(r, "kernel program headers past the first %u bytes", KHDR_LEN);
+			return;
+		}
+		if (get_be32(k + at) == 1) {
+			if (get_be32(k + at + 4) + (uint64_t) get_be32(k + at + 16) >
+			    r->kernel_size)
+				fail(r, "kernel segment runs past the kernel size");
+			return;
+		}
+	}
+	fail(r, "kernel has no loadable segment");
+}
+
+static void grab_khdr(struct image *im, const uint8_t *data, uint64_t at,
+		      size_t len) {
+	if (im->khdr_at + KHDR_LEN <= at || at + len <= im->khdr_at)
+		return;
+
+	const uint64_t from = im->khdr_at > at ? im->khdr_at : at;
+	const uint64_t to = im->khdr_at + KHDR_LEN < at + len ? im->khdr_at + KHDR_LEN
+							       : at + len;
+	memcpy(im->khdr + (from - im->khdr_at), data + (from - at), to - from);
+	if (to - im->khdr_at > im->khdr_len)
+		im->khdr_len = to - im->khdr_at;
+}
+
+static void audit_mapped(int fd, struct result *r) {
+	struct image im = { 0 };
+	struct stat st;
+
+	if (fstat(fd, &st)) {
+		fail(r, "%s", strerror(errno));
+		return;
+	}
+	const size_t len = st.st_size;
+	const uint8_t *const map =
+		len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0)
+		    : NULL;
+	if (len && map == MAP_FAILED) {
+		fail(r, "mmap: %s", strerror(errno));
+		return;
+	}
+	if (len)
+		madvise((void *) map, len, MADV_SEQUENTIAL);
+
+	im.head = map;
+	im.headlen = len;
+	im.size = len;
+	check_head(&im, r);
+	if (im.khdr_at < len)
+		grab_khdr(&im, map + im.khdr_at, im.khdr_at,
+			  len - im.khdr_at < KHDR_LEN ? len - im.khdr_at : KHDR_LEN);
+	check_tail(&im, r);
+
+	if (len)
+		munmap((void *) map, len);
+}
+
+static void audit_gz(int fd, struct result *r) {
+	static _Thread_local uint8_t head[HEAD_LEN], buf[1 << 17];
+	struct image im = { .head = head };
+	int n;
+
+	gzFile gz = gzdopen(fd, "rb");
+	if (!gz) {
+		fail(r, "gzdopen failed");
+		close(fd);
+		return;
+	}
+	gzbuffer(gz, 1 << 17);
+
+	// The head first, then the rest only for its size and a far kernel
+	while (im.headlen < HEAD_LEN &&
+	       (n = gzread(gz, head + im.headlen, HEAD_LEN - im.headlen)) > 0)
+		im.headlen += n;
+	im.size = im.headlen;
+
+	check_head(&im, r);
+	grab_khdr(&im, head, 0, im.headlen);
+
+	while ((n = gzread(gz, buf, sizeof(buf))) > 0) {
+		grab_khdr(&im, buf, im.size, n);
+		im.size += n;
+	}
+	if (n < 0) {
+		int err;
+		fail(r, "gzip: %s", gzerror(gz, &err));
+	}
+	gzclose(gz);
+
+	check_tail(&im, r);
+}
+
+static void *worker(void *arg) {
+	unsigned i;
+
+	(void) arg;
+	while ((i = atomic_fetch_add(&next_path, 1)) < npaths) {
+		struct result *const r = &results[i];
+		const size_t len = strlen(paths[i]);
+
+		r->path = paths[i];
+		const int fd = open(paths[i], O_RDONLY);
+		if (fd < 0) {
+			fail(r, "%s", strerror(errno));
+			continue;
+		}
+		if (len > 3 && !strcmp(paths[i] + len - 3, ".gz")) {
+			audit_gz(fd, r); // closes fd
+		} else {
+			audit_mapped(fd, r);
+			close(fd);
+		}
+	}
+	return NULL;
+}
+
+static void json_string(const char *s) {
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+int main(int argc, char **argv) {
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	int opt, only_failed = 0, first = 1;
+	unsigned i, failed = 0;
+
+	while ((opt = getopt(argc, argv, "j:f")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atol(optarg);
+			break;
+		case 'f':
+			only_failed = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind >= argc || jobs < 1) {
+usage:
+		printf("Usage: %s [-j threads] [-f] image.z64|image.z64.gz...\n",
+		       argv[0]);
+		printf("-f lists only the images that fail\n");
+		return 2;
+	}
+
+	paths = argv + optind;
+	npaths = argc - optind;
+	if (jobs > npaths)
+		jobs = npaths;
+	if (!(results = calloc(npaths, sizeof(*results))))
+		abort();
+
+	pthread_t *const tids = calloc(jobs, sizeof(*tids));
+	if (!tids)
+		abort();
+	for (i = 0; i < jobs; i++)
+		if (pthread_create(&tids[i], NULL, worker, NULL))
+			abort();
+	for (i = 0; i < jobs; i++)
+		pthread_join(tids[i], NULL);
+
+	printf("[");
+	for (i = 0; i < npaths; i++) {
+		const struct result *const r = &results[i];
+		unsigned e;
+
+		if (r->nerrors)
+			failed++;
+		if (only_failed && !r->nerrors)
+			continue;
+
+		printf("%s\n{\"file\":", first ? "" : ",");
+		first = 0;
+		json_string(r->path);
+		printf(",\"ok\":%s,\"size\":%llu", r->nerrors ? "false" : "true",
+		       (unsigned long long) r->size);
+		if (r->cic)
+			printf(",\"cic\":%u,\"kernel\":{\"offset\":%llu,\"size\":%u,"
+			       "\"format\":\"%s\"},\"disk\":{\"offset\":%llu,\"size\":%u}",
+			       r->cic, (unsigned long long) r->kernel_at, r->kernel_size,
+			       r->kernel_kind ? r->kernel_kind : "none",
+			       (unsigned long long) r->disk_at, r->disk_size);
+		printf(",\"errors\":[");
+		for (e = 0; e < r->nerrors; e++) {
+			if (e)
+				putchar(',');
+			json_string(r->errors[e]);
+		}
+		printf("],\"warnings\":[");
+		for (e = 0; e < r->nwarnings; e++) {
+			if (e)
+				putchar(',');
+			json_string(r->warnings[e]);
+		}
+		printf("]}");
+	}
+	printf("\n]\n");
+
+	fprintf(stderr, "%u images, %u failed\n", npaths, failed);
+	free(tids);
+	free(results);
+	return failed ? 1 : 0;
+}
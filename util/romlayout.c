@@ -0,0 +1,464 @@
+/* ROM layout solver.
+ *
+ * Places the payloads after the loader so that boot-critical ones stay
+ * contiguous in the order they are read, for back-to-back DMA, and fills
+ * the remaining holes with the rest. Alignment is honoured per payload,
+ * the boot table page below the kernel slot is kept free, and the
+ * smallest ROM size tier that fits is reported. Mapped payloads, which
+ * the kernel uses in place, get whole pages in the cart window.
+ *
+ * Outputs the layout boot table record, the matching n64tool placement
+ * arguments, and a report explaining where padding went. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "boottab.h"
+#include "rec.h"
+
+#define ROM_HEADER 0x1000 /* header and IPL3, before the loader */
+#define MAX_ITEMS 32
+#define MAX_HOLES (MAX_ITEMS * 2 + 4)
+#define OPEN_END UINT64_MAX
+
+#define PAYLOAD_NAME(id, name) name,
+static const char *const names[] = { PAYLOAD_IDS(PAYLOAD_NAME) };
+#undef PAYLOAD_NAME
+
+struct item {
+	const char *name, *file;
+	unsigned id, order, flags;
+	uint64_t size, align, off;
+	int fixed; /* placed by the caller, or reserved if there is no file */
+};
+
+struct hole {
+	uint64_t start, end;
+};
+
+static struct item items[MAX_ITEMS];
+static unsigned nitems;
+
+static struct hole holes[MAX_HOLES];
+static unsigned nholes;
+
+static uint64_t align_up(uint64_t v, uint64_t a) {
+	return (v + a - 1) / a * a;
+}
+
+static int parse_size(const char *s, uint64_t *out) {
+	char *end;
+	uint64_t v = strtoull(s, &end, 0);
+
+	if (end == s)
+		return -1;
+	if (*end == 'K' || *end == 'k')
+		v <<= 10, end++;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20, end++;
+	*out = v;
+	return *end && *end != ':' && *end != ',' && *end != '@' ? -1 : 0;
+}
+
+static int file_size(const char *path, uint64_t *size) {
+	struct stat st;
+
+	if (stat(path, &st))
+		return -1;
+	*size = st.st_size;
+	return 0;
+}
+
+static struct item *new_item(void) {
+	if (nitems >= MAX_ITEMS) {
+		puts("Too many payloads");
+		exit(1);
+	}
+	return &items[nitems++];
+}
+
+// name:file[:align[:order]][:mapped]
+static int parse_payload(char *spec) {
+	struct item *const it = new_item();
+	char *field;
+	unsigned i, pos = 0;
+
+	it->name = strtok(spec, ":");
+	it->file = strtok(NULL, ":");
+	it->align = 1;
+	if (!it->name || !it->file)
+		return -1;
+
+	for (i = 0; i < PL_NUM_IDS - 1; i++)
+		if (!strcmp(it->name, names[i]))
+			it->id = i + 1;
+	if (!it->id) {
+		printf("Unknown payload %s\n", it->name);
+		return -1;
+	}
+
+	while ((field = strtok(NULL, ":"))) {
+		if (!strcmp(field, "mapped"))
+			it->flags |= PL_F_MAPPED;
+		else if (pos++ == 0) {
+			if (parse_size(field, &it->align))
+				return -1;
+		} else
+			it->order = atoi(field);
+	}
+	if (!it->align || (it->align & (it->align - 1))) {
+		printf("%s: alignment must be a power of two\n", it->name);
+		return -1;
+	}
+	// PI DMA needs even cart addresses
+	if (it->align < 2)
+		it->align = 2;
+	if (it->order)
+		it->flags |= PL_F_CRITICAL;
+
+	if (it->flags & PL_F_MAPPED) {
+		// The loader reads these itself
+		if (it->id == PL_KERNEL || it->id == PL_KERNEL_ALT ||
+		    it->id == PL_DICT || it->id == PL_CMDLINE || it->order) {
+			printf("%s can't be mapped\n", it->name);
+			return -1;
+		}
+		// The kernel maps whole pages
+		if (it->align < PL_MAP_ALIGN)
+			it->align = PL_MAP_ALIGN;
+	}
+
+	if (file_size(it->file, &it->size)) {
+		printf("Can't stat %s\n", it->file);
+		return -1;
+	}
+	return 0;
+}
+
+// Bytes taken in the ROM: mapped payloads keep their last page
+static uint64_t span(const struct item *it) {
+	return it->flags & PL_F_MAPPED ? align_up(it->size, PL_MAP_ALIGN)
+				       : it->size;
+}
+
+static void carve(unsigned h, uint64_t start, uint64_t end) {
+	const struct hole old = holes[h];
+
+	memmove(&holes[h], &holes[h + 1], (nholes - h - 1) * sizeof(holes[0]));
+	nholes--;
+
+	if (end < old.end) {
+		memmove(&holes[h + 1], &holes[h], (nholes - h) * sizeof(holes[0]));
+		holes[h].start = end;
+		holes[h].end = old.end;
+		nholes++;
+	}
+	if (start > old.start) {
+		memmove(&holes[h + 1], &holes[h], (nholes - h) * sizeof(holes[0]));
+		holes[h].start = old.start;
+		holes[h].end = start;
+		nholes++;
+	}
+}
+
+static void reserve(uint64_t start, uint64_t end) {
+	unsigned h;
+
+	for (h = 0; h < nholes; h++) {
+		if (holes[h].end <= start || holes[h].start >= end)
+			continue;
+		const uint64_t s = start > holes[h].start ? start : holes[h].start;
+		const uint64_t e = end < holes[h].end ? end : holes[h].end;
+		carve(h, s, e);
+		h = (unsigned) -1; // the list changed, rescan
+	}
+}
+
+static int cmp_order(const void *a, const void *b) {
+	const struct item *const x = *(struct item * const *) a;
+	const struct item *const y = *(struct item * const *) b;
+
+	return (x->order > y->order) - (x->order < y->order);
+}
+
+static int cmp_cold(const void *a, const void *b) {
+	const struct item *const x = *(struct item * const *) a;
+	const struct item *const y = *(struct item * const *) b;
+
+	if (x->align != y->align)
+		return x->align < y->align ? 1 : -1;
+	return (span(x) < span(y)) - (span(x) > span(y));
+}
+
+/* The boot-critical chain goes in one piece. Within each hole try every
+ * start modulo the largest alignment, since that decides the padding
+ * between the payloads, and keep the one that ends lowest. */
+static int place_chain(struct item **chain, unsigned n) {
+	uint64_t best_start = 0, best_end = OPEN_END, maxalign = 1;
+	unsigned h, i, best_hole = 0;
+
+	if (!n)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		if (chain[i]->align > maxalign)
+			maxalign = chain[i]->align;
+
+	for (h = 0; h < nholes; h++) {
+		uint64_t start;
+
+		for (start = align_up(holes[h].start, chain[0]->align);
+		     start < align_up(holes[h].start, chain[0]->align) + maxalign;
+		     start += chain[0]->align) {
+			uint64_t cur = start;
+
+			for (i = 0; i < n; i++)
+				cur = align_up(cur, chain[i]->align) + span(chain[i]);
+			if (cur > holes[h].end || cur >= best_end)
+				continue;
+			best_start = start;
+			best_end = cur;
+			best_hole = h;
+		}
+	}
+
+	if (best_end == OPEN_END)
+		return -1;
+
+	uint64_t cur = best_start;
+	for (i = 0; i < n; i++) {
+		chain[i]->off = align_up(cur, chain[i]->align);
+		cur = chain[i]->off + span(chain[i]);
+	}
+	carve(best_hole, best_start, best_end);
+	return 0;
+}
+
+// Lowest address that fits, biggest alignment first
+static int place_cold(struct item *it) {
+	unsigned h;
+
+	for (h = 0; h < nholes; h++) {
+		const uint64_t start = align_up(holes[h].start, it->align);
+		if (start + span(it) > holes[h].end)
+			continue;
+		it->off = start;
+		carve(h, start, start + span(it));
+		return 0;
+	}
+	return -1;
+}
+
+static int cmp_off(const void *a, const void *b) {
+	const struct item *const x = *(struct item * const *) a;
+	const struct item *const y = *(struct item * const *) b;
+
+	return (x->off > y->off) - (x->off < y->off);
+}
+
+static void report(FILE *f, struct item **sorted, unsigned n, uint64_t end,
+		   uint64_t tier) {
+	uint64_t cur = 0, pad = 0, payload = 0;
+	unsigned i;
+
+	fprintf(f, "%-10s %-10s %-10s %-8s %s\n", "offset", "size", "padding",
+		"align", "payload");
+	for (i = 0; i < n; i++) {
+		const struct item *const it = sorted[i];
+		const uint64_t gap = it->off > cur ? it->off - cur : 0;
+		const char *why = "";
+
+		if (gap && it->fixed)
+			why = "  (gap before fixed slot)";
+		else if (gap && gap < it->align)
+			why = "  (alignment)";
+		else if (gap)
+			why = "  (nothing else fits)";
+
+		fprintf(f, "0x%08llx %-10llu %-10llu %-8llu %s%s%s%s\n",
+			(unsigned long long) it->off, (unsigned long long) it->size,
+			(unsigned long long) gap, (unsigned long long) it->align,
+			it->name, it->flags & PL_F_CRITICAL ? " [critical]" : "",
+			it->flags & PL_F_MAPPED ? " [mapped]" : "", why);
+		pad += gap + span(it) - it->size;
+		if (!it->fixed)
+			payload += it->size;
+		if (it->off + span(it) > cur)
+			cur = it->off + span(it);
+	}
+
+	fprintf(f, "\npayload bytes %llu, padding %llu, ROM end 0x%llx\n",
+		(unsigned long long) payload, (unsigned long long) pad,
+		(unsigned long long) end);
+	fprintf(f, "size tier %llu MB, %llu bytes unused at the end\n",
+		(unsigned long long) tier >> 20, (unsigned long long) (tier - end));
+}
+
+int main(int argc, char **argv) {
+	const char *loader = NULL, *reportpath = NULL, *tiers = "4M,8M,12M,16M,32M,64M";
+	struct item *chain[MAX_ITEMS], *cold[MAX_ITEMS], *sorted[MAX_ITEMS];
+	unsigned nchain = 0, ncold = 0, i;
+	uint64_t loadersize = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:t:r:x:")) != -1) {
+		switch (opt) {
+		case 'l':
+			loader = optarg;
+			break;
+		case 't':
+			tiers = optarg;
+			break;
+		case 'r':
+			reportpath = optarg;
+			break;
+		case 'x': {
+			// file@offset, placed as given and only listed for n64tool
+			struct item *const it = new_item();
+			char *at = strrchr(optarg, '@');
+
+			if (!at || parse_size(at + 1, &it->off))
+				goto usage;
+			*at = 0;
+			it->name = it->file = optarg;
+			it->fixed = 1;
+			it->align = 1;
+			file_size(it->file, &it->size);
+			break;
+		}
+		default:
+			goto usage;
+		}
+	}
+
+	if (argc - optind < 3) {
+usage:
+		printf("Usage: %s [-l loader.bin] [-t 4M,8M,...] [-r report.txt] "
+		       "[-x file@offset]... layout.rec layout.args "
+		       "name:file[:align[:order]][:mapped]...\n", argv[0]);
+		return 1;
+	}
+
+	for (i = optind + 2; i < (unsigned) argc; i++)
+		if (parse_payload(argv[i]))
+			goto usage;
+
+	if (loader && file_size(loader, &loadersize)) {
+		printf("Can't stat %s\n", loader);
+		return 1;
+	}
+
+	// Header and IPL3, the loader IPL3 copies, and the boot table page
+	static const char *const fixed_names[] = { "header", "loader", "boot table page" };
+	const uint64_t fixed_off[] = { 0, ROM_HEADER, BOOTTAB_ADDR - ROM_ADDR(0) };
+	const uint64_t fixed_size[] = { ROM_HEADER, loadersize, 0x1000 };
+	for (i = 0; i < 3; i++) {
+		struct item *const it = new_item();
+		it->name = fixed_names[i];
+		it->off = fixed_off[i];
+		it->size = fixed_size[i];
+		it->align = 1;
+		it->fixed = 1;
+	}
+
+	holes[0].start = 0;
+	holes[0].end = OPEN_END;
+	nholes = 1;
+
+	for (i = 0; i < nitems; i++) {
+		if (items[i].fixed)
+			reserve(items[i].off, items[i].off + items[i].size);
+		else if (items[i].order)
+			chain[nchain++] = &items[i];
+		else
+			cold[ncold++] = &items[i];
+	}
+
+	qsort(chain, nchain, sizeof(chain[0]), cmp_order);
+	qsort(cold, ncold, sizeof(cold[0]), cmp_cold);
+
+	if (place_chain(chain, nchain)) {
+		puts("The boot-critical payloads do not fit");
+		return 1;
+	}
+	for (i = 0; i < ncold; i++) {
+		if (place_cold(cold[i])) {
+			printf("%s does not fit\n", cold[i]->name);
+			return 1;
+		}
+	}
+
+	uint64_t end = 0, tier = 0;
+	for (i = 0; i < nitems; i++) {
+		sorted[i] = &items[i];
+		if (items[i].off + span(&items[i]) > end)
+			end = items[i].off + span(&items[i]);
+	}
+	qsort(sorted, nitems, sizeof(sorted[0]), cmp_off);
+
+	char tierbuf[256];
+	snprintf(tierbuf, sizeof(tierbuf), "%s", tiers);
+	for (char *t = strtok(tierbuf, ","); t; t = strtok(NULL, ",")) {
+		uint64_t v;
+		if (!parse_size(t, &v) && v >= end && (!tier || v < tier))
+			tier = v;
+	}
+	if (!tier) {
+		printf("Layout needs %llu bytes, more than the largest size tier\n",
+		       (unsigned long long) end);
+		return 1;
+	}
+
+	// Layout record, in payload order
+	uint8_t rec[MAX_ITEMS * sizeof(struct bt_payload)];
+	unsigned reclen = 0;
+	for (i = 0; i < nitems; i++) {
+		if (items[i].fixed)
+			continue;
+		if (items[i].off > UINT32_MAX || items[i].size > UINT32_MAX) {
+			printf("%s does not fit a 32-bit ROM offset\n", items[i].name);
+			return 1;
+		}
+		if (items[i].flags & PL_F_MAPPED &&
+		    items[i].off + span(&items[i]) > PL_MAP_LIMIT) {
+			printf("%s ends past the cart window\n", items[i].name);
+			return 1;
+		}
+		put_be16(rec + reclen, items[i].id);
+		put_be16(rec + reclen + 2, items[i].flags);
+		put_be32(rec + reclen + 4, items[i].off);
+		put_be32(rec + reclen + 8, items[i].size);
+		reclen += sizeof(struct bt_payload);
+	}
+	if (write_rec(argv[optind], BT_LAYOUT, rec, reclen)) {
+		puts("Can't write record");
+		return 1;
+	}
+
+	// n64tool offsets count from the end of the ROM header
+	FILE *f = fopen(argv[optind + 1], "w");
+	if (!f) {
+		printf("Can't write %s\n", argv[optind + 1]);
+		return 1;
+	}
+	for (i = 0; i < nitems; i++)
+		if (sorted[i]->file)
+			fprintf(f, "-s %lluB %s\n",
+			(unsigned long long) sorted[i]->off - ROM_HEADER, sorted[i]->file);
+	fclose(f);
+
+	f = reportpath ? fopen(reportpath, "w") : stderr;
+	if (!f) {
+		printf("Can't write %s\n", reportpath);
+		return 1;
+	}
+	report(f, sorted, nitems, end, tier);
+	if (f != stderr)
+		fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+/* Host model of the RSP LZB decoder.
+ *
+ * Runs the block loop of src/rsp_lzb.S over a 4 KB DMEM image the way the
+ * microcode does, 8-byte overcopies included, so that a stream the RSP
+ * would mishandle shows up here: any write past the OUTBUF slack or read
+ * past the stored block is reported instead of silently corrupting DMEM.
+ * Batching follows lzb_load() in src/decomp.c.
+ *
+ * Cycles are instruction counts of the loops in rsp_lzb.S, one per
+ * instruction, plus a rough SP DMA cost. Keep both in step with the
+ * microcode. */
+
+#include <string.h>
+
+#include "rspmodel.h"
+#include "lzb.h"
+#include "be.h"
+
+#define DMEM 4096
+#define SLACK 16
+
+/* DMEM layout of rsp_lzb.S */
+#define PARAMS 0
+#define TABLE (PARAMS + 16)
+#define OUTBUF LZB_ALIGN8(TABLE + LZB_BATCH * 2)
+#define INBUF LZB_ALIGN8(OUTBUF + LZB_BLOCK + SLACK)
+#define DMEM_END (INBUF + LZB_MAX_CSIZE + SLACK)
+
+#if DMEM_END > DMEM
+#error "LZB buffers do not fit DMEM"
+#endif
+
+/* SP DMA, roughly: fixed setup then 4 bytes per RSP cycle */
+#define DMA_SETUP 32
+#define DMA_BPC 4
+
+/* Instructions per step, counted from rsp_lzb.S */
+#define C_START 5
+#define C_BLOCK 11 /* block_loop up to the raw check */
+#define C_DMA_IN 13 /* call, dma_in and return, one poll */
+#define C_DMA_OUT 14
+#define C_DECODE_CALL 7
+#define C_TAIL 5
+#define C_SEQ 5
+#define C_EXT 6 /* per length byte */
+#define C_LIT0 2
+#define C_COPY8 6 /* per 8-byte step */
+#define C_COPY_END 2
+#define C_CHECK 3
+#define C_OFFSET 5
+#define C_MATCH 5
+#define C_NEAR 6 /* per byte */
+#define C_RET 2
+
+// Per thread, so the sweep tool can model several containers at once
+static _Thread_local uint8_t dmem[DMEM];
+static _Thread_local unsigned hiwater; /* end of the furthest 8-byte store */
+
+static uint64_t dma(unsigned len) {
+	return DMA_SETUP + (len + DMA_BPC - 1) / DMA_BPC;
+}
+
+static void copy8(unsigned dst, unsigned src) {
+	uint8_t v[8];
+	unsigned i;
+
+	// ldv then sdv, DMEM addresses wrap
+	for (i = 0; i < 8; i++)
+		v[i] = dmem[(src + i) & (DMEM - 1)];
+	for (i = 0; i < 8; i++)
+		dmem[(dst + i) & (DMEM - 1)] = v[i];
+	if (dst + 8 > hiwater)
+		hiwater = dst + 8;
+}
+
+#define FAIL(msg)	\
+	do {		\
+		err = msg;	\
+		goto out;	\
+	} while (0)
+
+/* Mirror of decode: a0 in, a1 out, end of output a2 */
+static const char *decode(unsigned csize, unsigned usize, uint64_t *cyc) {
+	const unsigned iend = INBUF + csize, oend = OUTBUF + usize;
+	unsigned a0 = INBUF, a1 = OUTBUF, b;
+	const char *err = NULL;
+	uint64_t c = 1;
+
+	hiwater = 0;
+
+	while (1) {
+		if (a0 >= iend)
+			FAIL("token read past the stored block");
+		const unsigned token = dmem[a0++];
+		int lit = token >> 4, len = token & 15;
+		c += C_SEQ;
+
+		if (lit == 15) {
+			do {
+				if (a0 >= iend)
+					FAIL("length read past the stored block");
+				b = dmem[a0++];
+				lit += b;
+				c += C_EXT;
+			} while (b == 255);
+		}
+
+		c += C_LIT0;
+		if (lit) {
+			if (a0 + lit > iend)
+				FAIL("literals past the stored block");
+			if (a1 + lit > oend)
+				FAIL("literals past the block end");
+			while (lit > 0) {
+				copy8(a1, a0);
+				a0 += 8;
+				a1 += 8;
+				lit -= 8;
+				c += C_COPY8;
+			}
+			a0 += lit;
+			a1 += lit;
+			c += C_COPY_END;
+		}
+
+		c += C_CHECK;
+		if (a1 >= oend) {
+			c += C_RET;
+			break;
+		}
+
+		if (a0 + 2 > iend)
+			FAIL("offset read past the stored block");
+		const unsigned off = dmem[a0] << 8 | dmem[a0 + 1];
+		a0 += 2;
+		c += C_OFFSET;
+
+		if (len == 15) {
+			do {
+				if (a0 >= iend)
+					FAIL("length read past the stored block");
+				b = dmem[a0++];
+				len += b;
+				c += C_EXT;
+			} while (b == 255);
+		}
+		len += LZB_MIN_MATCH;
+		c += C_MATCH;
+
+		if (!off || off > a1 - OUTBUF)
+			FAIL("match before the block start");
+		if (a1 + len > oend)
+			FAIL("match past the block end");
+
+		unsigned src = a1 - off;
+		if (off >= 8) {
+			while (len > 0) {
+				copy8(a1, src);
+				src += 8;
+				a1 += 8;
+				len -= 8;
+				c += C_COPY8;
+			}
+			a1 += len;
+			c += C_COPY_END;
+		} else {
+			while (len-- > 0) {
+				dmem[a1++] = dmem[src++];
+				c += C_NEAR;
+			}
+		}
+
+		c += C_CHECK;
+		if (a1 >= oend) {
+			c += C_RET;
+			break;
+		}
+	}
+
+	// Overcopies must stay within the slack behind OUTBUF
+	if (hiwater > OUTBUF + LZB_BLOCK + SLACK)
+		err = "output overran OUTBUF";
+out:
+	*cyc += c;
+	return err;
+}
+
+/* Decode the container in into out, which must hold its usize rounded up
+ * to 8, as the RSP would. If block_cycles is given it receives the cycles
+ * of each block. Returns NULL, or what went wrong. */
+const char *rsp_model(const uint8_t *in, size_t inlen, uint8_t *out,
+		      size_t outlen, struct rsp_stats *st,
+		      uint32_t *block_cycles) {
+	uint32_t i, j;
+
+	memset(st, 0, sizeof(*st));
+
+	if (inlen < sizeof(struct lzb_hdr) || get_be32(in) != LZB_MAGIC)
+		return "not an LZB container";
+
+	const uint32_t usize = get_be32(in + 4);
+	const uint32_t n = get_be32(in + 8);
+	if (n != (usize + LZB_BLOCK - 1) / LZB_BLOCK ||
+	    LZB_DATA_OFFSET(n) > inlen || LZB_ALIGN8(usize) > outlen)
+		return "bad container header";
+
+	size_t src = LZB_DATA_OFFSET(n);
+	for (i = 0; i < n; st->runs++) {
+		const uint32_t cnt = n - i < LZB_BATCH ? n - i : LZB_BATCH;
+
+		st->cycles += C_START;
+		for (j = 0; j < cnt; j++, i++) {
+			const unsigned csize = get_be16(in + sizeof(struct lzb_hdr) + 2 * i);
+			const unsigned usz = LZB_BLOCK_SIZE(usize, i);
+			const uint64_t before = st->cycles;
+			const char *err;
+
+			if (csize > LZB_ALIGN8(usz) || csize > inlen - src)
+				return "stored block too large";
+
+			st->cycles += C_BLOCK;
+			st->blocks++;
+
+			if (csize == LZB_ALIGN8(usz)) {
+				memcpy(dmem + OUTBUF, in + src, csize);
+				st->raw++;
+			} else {
+				if (csize > LZB_MAX_CSIZE)
+					return "stored block does not fit INBUF";
+				memcpy(dmem + INBUF, in + src, csize);
+				st->cycles += C_DECODE_CALL;
+				if ((err = decode(csize, usz, &st->cycles)))
+					return err;
+			}
+			st->cycles += C_DMA_IN + dma(csize);
+			st->dma_cycles += dma(csize);
+
+			memcpy(out + (size_t) i * LZB_BLOCK, dmem + OUTBUF, LZB_ALIGN8(usz));
+			st->cycles += C_DMA_OUT + C_TAIL + dma(LZB_ALIGN8(usz));
+			st->dma_cycles += dma(LZB_ALIGN8(usz));
+
+			if (block_cycles)
+				block_cycles[i] = st->cycles - before;
+			src += csize;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,21 @@
+/* Host model of the RSP LZB decoder in src/rsp_lzb.S. */
+
+#ifndef RSPMODEL_H
+#define RSPMODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSP_HZ 62500000
+
+struct rsp_stats {
+	uint64_t cycles;     /* total, including DMA waits */
+	uint64_t dma_cycles; /* spent waiting on SP DMA */
+	uint32_t runs, blocks, raw;
+};
+
+const char *rsp_model(const uint8_t *in, size_t inlen, uint8_t *out,
+		      size_t outlen, struct rsp_stats *st,
+		      uint32_t *block_cycles);
+
+#endif
@@ -0,0 +1,411 @@
+/* Loader design-space sweep.
+ *
+ * Models the kernel load for every combination of codec and level, PI
+ * timing set and ROM layout mode, and prints the Pareto front of ROM size
+ * against predicted load time. Compression runs for
+ * real, one level per thread, and the RSP decode cost per block comes
+ * from the RSP model, so the result tracks the actual payloads. The PI
+ * and CPU costs are the rough figures below. The DMA sizes are fixed by
+ * the loader: a plain ELF segment is read in one transfer and LZB blocks
+ * in batches of LZB_BATCH, so there is no chunk size to sweep.
+ *
+ * The load time covers what differs between settings: header and table
+ * reads, the kernel transfer with its decode pipeline, cache maintenance
+ * and bss clearing. Console setup and the fixed delays are left out. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lzbcomp.h"
+#include "rspmodel.h"
+#include "jobs.h"
+#include "file.h"
+#include "be.h"
+
+#define CPU_HZ 93750000
+#define RCP_HZ 62500000
+
+/* CPU costs, in CPU cycles */
+#define DMA_CALL 400       /* dma_read() setup and completion */
+#define RSP_KICK 1200      /* parameter upload and run, per batch */
+#define RSP_LOAD 3000      /* microcode upload, once */
+#define CACHE_PER_LINE 4   /* hit writeback-invalidate per 16 bytes */
+#define MEMSET_PER_WORD 1  /* bss clearing, per 4 bytes */
+
+#define ROM_KERNEL 0x101000 /* fixed layout kernel slot */
+#define BOOTTAB_PAGE 0x100000
+
+#define MAX_LIST 16
+
+struct timing {
+	char name[16];
+	unsigned lat, pwd, pgs, rls;
+};
+
+struct codec {
+	int level;         /* 0 for the plain ELF */
+	uint8_t *data;     /* LZB container */
+	size_t size;       /* bytes in ROM */
+	uint32_t nblocks;
+	uint32_t *cycles;  /* RSP cycles per block */
+	const char *err;
+};
+
+struct result {
+	unsigned codec, timing, layout;
+	uint64_t rom_end, tier;
+	double ms;
+};
+
+/* Example DOM1 sets: the usual header value IPL3 programs, and a faster
+ * one for carts that take it. Replaced by -p. */
+static struct timing timings[MAX_LIST] = {
+	{ "ipl3", 0x40, 0x12, 0x07, 0x03 },
+	{ "fast", 0x05, 0x0C, 0x0D, 0x02 },
+};
+static unsigned ntimings = 2;
+
+static struct codec codecs[MAX_LIST] = {
+	{ .level = 0 }, { .level = 1 }, { .level = 4 }, { .level = 9 },
+};
+static unsigned ncodecs = 4;
+
+static const char *const layouts[] = { "fixed", "packed" };
+#define NLAYOUTS 2
+
+static const char *tiers = "4M,8M,12M,16M,32M,64M";
+
+/* The kernel as the loader sees it */
+static const uint8_t *kfile, *segment;
+static size_t kfile_size;
+static uint32_t filesz, memsz;
+static uint64_t disk_size, loader_size = 64 << 10;
+
+static struct result *results;
+static unsigned nresults;
+
+static uint64_t align_up(uint64_t v, uint64_t a) {
+	return (v + a - 1) / a * a;
+}
+
+static int parse_size(const char *s, uint64_t *out) {
+	char *end;
+	uint64_t v = strtoull(s, &end, 0);
+
+	if (end == s)
+		return -1;
+	if (*end == 'K' || *end == 'k')
+		v <<= 10, end++;
+	else if (*end == 'M' || *end == 'm')
+		v <<= 20, end++;
+	if (*end)
+		return -1;
+	*out = v;
+	return 0;
+}
+
+static void compress_job(void *ctx, unsigned i) {
+	struct codec *const c = &codecs[i];
+	struct rsp_stats st;
+
+	(void) ctx;
+	if (!c->level) {
+		c->size = kfile_size;
+		return;
+	}
+
+	c->data = lzb_compress(segment, filesz, c->level, NULL, &c->size);
+	c->nblocks = (filesz + LZB_BLOCK - 1) / LZB_BLOCK;
+	c->cycles = calloc(c->nblocks + 1, sizeof(*c->cycles));
+	uint8_t *const out = malloc(LZB_ALIGN8(filesz) + 8);
+	if (!c->data || !c->cycles || !out)
+		abort();
+
+	c->err = rsp_model(c->data, c->size, out, LZB_ALIGN8(filesz), &st, c->cycles);
+	free(out);
+}
+
+// PI transfer time, in RCP cycles
+static double pi_cycles(const struct timing *t, uint64_t bytes) {
+	const uint64_t page = 4ull << t->pgs;
+
+	return (double) (bytes + page - 1) / page * (t->lat + 1) +
+	       (double) (bytes + 1) / 2 * (t->pwd + 1 + t->rls + 1);
+}
+
+static double pi_s(const struct timing *t, uint64_t bytes) {
+	return pi_cycles(t, bytes) / RCP_HZ + (double) DMA_CALL / CPU_HZ;
+}
+
+static double cpu_s(double cycles) {
+	return cycles / CPU_HZ;
+}
+
+// Seconds to get the kernel into RAM and ready to enter
+static double load_time(const struct codec *c, const struct timing *t) {
+	double s = pi_s(t, 256);
+	uint32_t i, j;
+
+	s += cpu_s((double) CACHE_PER_LINE * (filesz / 16));
+	s += cpu_s((double) MEMSET_PER_WORD * ((memsz - filesz) / 4));
+
+	if (!c->level)
+		return s + pi_s(t, filesz);
+
+	/* Mirror of lzb_load(): the PI fetches batch i while the RSP decodes
+	 * batch i - 1, and the RSP starts a batch once both are done. */
+	const uint32_t per = LZB_BATCH;
+	double pi_at = s + pi_s(t, 2 * c->nblocks) + cpu_s(RSP_LOAD);
+	double rsp_end = pi_at, rsp_start = pi_at;
+
+	for (i = 0; i < c->nblocks; i += per) {
+		const uint32_t cnt = c->nblocks - i < per ? c->nblocks - i : per;
+		uint64_t bytes = 0;
+		double rsp = 0;
+
+		for (j = i; j < i + cnt; j++) {
+			bytes += get_be16(c->data + sizeof(struct lzb_hdr) + 2 * j);
+			rsp += (double) c->cycles[j] / RSP_HZ;
+		}
+
+		const double pi_end = (i ? rsp_start : pi_at) + pi_s(t, bytes);
+		rsp_start = (pi_end > rsp_end ? pi_end : rsp_end) + cpu_s(RSP_KICK);
+		rsp_end = rsp_start + rsp;
+	}
+
+	return rsp_end;
+}
+
+// ROM end for a layout mode, with the kernel stored as ksize bytes
+static uint64_t rom_end(unsigned layout, uint64_t ksize) {
+	if (!layout)
+		return ROM_KERNEL + align_up(ksize, 4096) + disk_size;
+
+	/* Packed: first fit into the hole between loader and boot table page,
+	 * else after it, as util/romlayout does for these two */
+	uint64_t lo = 0x1000 + align_up(loader_size, 16), hi = ROM_KERNEL;
+	const uint64_t sizes[2] = { ksize, disk_size }, aligns[2] = { 16, 4096 };
+	uint64_t end = ROM_KERNEL;
+	unsigned i;
+
+	for (i = 0; i < 2; i++) {
+		const uint64_t at = align_up(lo, aligns[i]);
+
+		if (at + sizes[i] <= BOOTTAB_PAGE) {
+			lo = at + sizes[i];
+		} else {
+			hi = align_up(hi, aligns[i]) + sizes[i];
+			if (hi > end)
+				end = hi;
+		}
+	}
+
+	return end;
+}
+
+static uint64_t tier_of(uint64_t end) {
+	char buf[256];
+	uint64_t tier = 0, v;
+
+	snprintf(buf, sizeof(buf), "%s", tiers);
+	for (char *t = strtok(buf, ","); t; t = strtok(NULL, ","))
+		if (!parse_size(t, &v) && v >= end && (!tier || v < tier))
+			tier = v;
+	return tier;
+}
+
+static void model_job(void *ctx, unsigned n) {
+	struct result *const r = &results[n];
+
+	(void) ctx;
+	r->layout = n % NLAYOUTS;
+	n /= NLAYOUTS;
+	r->timing = n % ntimings;
+	r->codec = n / ntimings;
+
+	const struct codec *const c = &codecs[r->codec];
+	r->ms = load_time(c, &timings[r->timing]) * 1000;
+	r->rom_end = rom_end(r->layout, c->size);
+}
+
+static int by_size(const void *a, const void *b) {
+	const struct result *const x = a, *const y = b;
+
+	if (x->rom_end != y->rom_end)
+		return x->rom_end < y->rom_end ? -1 : 1;
+	return x->ms < y->ms ? -1 : x->ms > y->ms;
+}
+
+// First PT_LOAD of a big-endian ELF32, else the whole file
+static void find_segment(void) {
+	uint32_t i;
+
+	segment = kfile;
+	filesz = memsz = kfile_size;
+
+	if (kfile_size < 52 || memcmp(kfile, "\177ELF", 4) || kfile[4] != 1 ||
+	    kfile[5] != 2)
+		return;
+
+	const uint32_t phoff = get_be32(kfile + 28);
+	const unsigned phentsize = get_be16(kfile + 42), phnum = get_be16(kfile + 44);
+
+	for (i = 0; i < phnum; i++) {
+		const uint8_t *const ph = kfile + phoff + i * phentsize;
+
+		if (phoff + (i + 1) * phentsize > kfile_size)
+			return;
+		if (get_be32(ph) != 1)
+			continue;
+		if (get_be32(ph + 4) + (uint64_t) get_be32(ph + 16) > kfile_size)
+			return;
+
+		segment = kfile + get_be32(ph + 4);
+		filesz = get_be32(ph + 16);
+		memsz = get_be32(ph + 20);
+		return;
+	}
+}
+
+static int parse_list(char *s, void (*add)(const char *)) {
+	for (char *t = strtok(s, ","); t; t = strtok(NULL, ","))
+		add(t);
+	return 0;
+}
+
+static int bad_arg;
+
+static void add_level(const char *s) {
+	const int level = atoi(s);
+
+	if (ncodecs >= MAX_LIST || level < 0 || level > LZB_MAX_LEVEL)
+		bad_arg = 1;
+	else
+		codecs[ncodecs++].level = level;
+}
+
+// name=LAT:PWD:PGS:RLS
+static void add_timing(const char *s) {
+	struct timing *const t = &timings[ntimings];
+	const char *eq = strchr(s, '=');
+
+	if (ntimings >= MAX_LIST || !eq || eq - s >= (int) sizeof(t->name) ||
+	    sscanf(eq + 1, "%i:%i:%i:%i", &t->lat, &t->pwd, &t->pgs, &t->rls) != 4 ||
+	    t->lat > 255 || t->pwd > 255 || t->pgs > 15 || t->rls > 3) {
+		bad_arg = 1;
+		return;
+	}
+	memcpy(t->name, s, eq - s);
+	t->name[eq - s] = 0;
+	ntimings++;
+}
+
+int main(int argc, char **argv) {
+	long nthreads = default_jobs();
+	int opt, all = 0, custom_timing = 0;
+	unsigned i;
+
+	while ((opt = getopt(argc, argv, "j:l:z:p:t:a")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 'l':
+			if (parse_size(optarg, &loader_size))
+				goto usage;
+			break;
+		case 'z':
+			ncodecs = 0;
+			parse_list(optarg, add_level);
+			break;
+		case 'p':
+			if (!custom_timing++)
+				ntimings = 0;
+			add_timing(optarg);
+			break;
+		case 't':
+			tiers = optarg;
+			break;
+		case 'a':
+			all = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (bad_arg || !ncodecs || argc - optind != 2) {
+usage:
+		printf("Usage: %s [-j threads] [-l loadersize] [-z 0,1,...,9] "
+		       "[-p name=LAT:PWD:PGS:RLS]... [-t 4M,8M,...] [-a] "
+		       "kernel disk\n", argv[0]);
+		return 1;
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+
+	if (!(kfile = load_file(argv[optind], &kfile_size))) {
+		printf("Can't read %s\n", argv[optind]);
+		return 1;
+	}
+
+	size_t dsize;
+	uint8_t *const disk = load_file(argv[optind + 1], &dsize);
+	if (!disk) {
+		printf("Can't read %s\n", argv[optind + 1]);
+		return 1;
+	}
+	disk_size = dsize;
+	free(disk);
+
+	find_segment();
+	if (memsz < filesz)
+		memsz = filesz;
+
+	run_jobs(ncodecs, compress_job, NULL, nthreads);
+	for (i = 0; i < ncodecs; i++) {
+		if (codecs[i].err) {
+			printf("Level %d: RSP model: %s\n", codecs[i].level, codecs[i].err);
+			return 1;
+		}
+	}
+
+	nresults = ncodecs * ntimings * NLAYOUTS;
+	if (!(results = calloc(nresults, sizeof(*results))))
+		abort();
+	run_jobs(nresults, model_job, NULL, nthreads);
+
+	for (i = 0; i < nresults; i++)
+		results[i].tier = tier_of(results[i].rom_end);
+	qsort(results, nresults, sizeof(*results), by_size);
+
+	printf("%-6s %-8s %-8s %-10s %-8s %-9s %s\n", "codec", "timing", "layout",
+	       "rom end", "tier", "load ms", "pareto");
+
+	double best = 0;
+	for (i = 0; i < nresults; i++) {
+		const struct result *const r = &results[i];
+		const int front = !i || r->ms < best;
+		char codec[8];
+
+		if (front)
+			best = r->ms;
+		if (!front && !all)
+			continue;
+
+		if (codecs[r->codec].level)
+			snprintf(codec, sizeof(codec), "lzb%d", codecs[r->codec].level);
+		else
+			snprintf(codec, sizeof(codec), "none");
+
+		printf("%-6s %-8s %-8s 0x%08llx %-8llu %-9.2f %s\n", codec,
+		       timings[r->timing].name,
+		       layouts[r->layout], (unsigned long long) r->rom_end,
+		       (unsigned long long) r->tier >> 20, r->ms, front ? "*" : "");
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* Decode the boot telemetry log from a cartridge SRAM dump into CSV.
+ *
+ * Accepts raw big-endian dumps as well as the word-swapped .sra files
+ * some emulators write. One row per recorded boot, oldest first. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "trace.h"
+#include "be.h"
+
+#define TRACE_NAME(id, name) name,
+static const char *const names[] = { TRACE_IDS(TRACE_NAME) };
+#undef TRACE_NAME
+
+#define LOG_SIZE (16 + TELEM_SLOTS * (12 + TELEM_PHASES * 4) + 8)
+
+static void swap32(uint8_t *p, size_t len) {
+	size_t i;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		uint8_t t = p[i];
+		p[i] = p[i + 3];
+		p[i + 3] = t;
+		t = p[i + 1];
+		p[i + 1] = p[i + 2];
+		p[i + 2] = t;
+	}
+}
+
+static int check(const uint8_t *p) {
+	uint32_t sum = 0;
+	unsigned i;
+
+	if (get_be32(p) != TELEM_MAGIC)
+		return -1;
+	if (get_be16(p + 4) != TELEM_VERSION || get_be16(p + 6) != TELEM_SLOTS) {
+		puts("Unsupported telemetry version");
+		return -1;
+	}
+
+	for (i = 0; i < LOG_SIZE - 8; i += 4)
+		sum += get_be32(p + i);
+	if (sum != get_be32(p + LOG_SIZE - 8)) {
+		puts("Telemetry checksum mismatch");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	static uint8_t sram[TELEM_SRAM_OFFSET + LOG_SIZE];
+	unsigned i, j;
+
+	if (argc < 2) {
+		printf("Usage: %s save.sra [out.csv]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		puts("Can't open input");
+		return 1;
+	}
+	if (fread(sram, 1, sizeof(sram), f) != sizeof(sram)) {
+		puts("Save dump too short");
+		return 1;
+	}
+	fclose(f);
+
+	uint8_t *const p = sram + TELEM_SRAM_OFFSET;
+	if (get_be32(p) != TELEM_MAGIC)
+		swap32(sram, sizeof(sram));
+	if (check(p)) {
+		puts("No boot telemetry found");
+		return 1;
+	}
+
+	FILE *out = stdout;
+	if (argc == 3 && !(out = fopen(argv[2], "w"))) {
+		puts("Can't open output");
+		return 1;
+	}
+
+	fprintf(out, "boot,reset,verify,pi_lat,pi_pwd,pi_pgs,pi_rls");
+	for (i = 0; i < TRACE_NUM_IDS && i < TELEM_PHASES; i++) {
+		const char *c;
+
+		fputc(',', out);
+		for (c = names[i]; *c; c++)
+			fputc(*c == ' ' ? '_' : *c, out);
+		fprintf(out, "_us");
+	}
+	fprintf(out, "\n");
+
+	const uint32_t head = get_be32(p + 12);
+	for (i = 0; i < TELEM_SLOTS; i++) {
+		const uint8_t *b = p + 16 + ((head + i) % TELEM_SLOTS) *
+			(12 + TELEM_PHASES * 4);
+		const uint32_t seq = get_be32(b);
+
+		if (!seq)
+			continue;
+
+		fprintf(out, "%u,%s,0x%02x,%u,%u,%u,%u", seq,
+			b[4] == TELEM_WARM ? "warm" : "cold", b[5],
+			b[8], b[9], b[10], b[11]);
+		for (j = 0; j < TRACE_NUM_IDS && j < TELEM_PHASES; j++) {
+			if (j < b[6])
+				fprintf(out, ",%.1f", get_be32(b + 12 + j * 4) *
+					1e6 / TRACE_COUNT_HZ);
+			else
+				fprintf(out, ",");
+		}
+		fprintf(out, "\n");
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
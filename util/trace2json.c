@@ -0,0 +1,207 @@
+/* Convert a boot trace into Chrome trace / Perfetto JSON.
+ *
+ * The input is either a RAM dump containing the loader's trace buffer, or
+ * a debug log with the "@T" lines printed by trace_dump(). CPU phases
+ * nest on one track, PI and SP DMA spans get their own tracks, so overlap
+ * between DMA and CPU work is visible directly. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "trace.h"
+#include "be.h"
+
+#define TRACE_NAME(id, name) name,
+static const char *const names[] = { TRACE_IDS(TRACE_NAME) };
+#undef TRACE_NAME
+
+static const char *const tracks[TRACE_TRACKS] = { "CPU", "PI DMA", "SP DMA/RSP" };
+
+static struct trace_event ev[TRACE_MAX_EVENTS];
+static uint64_t ticks[TRACE_MAX_EVENTS];
+static unsigned nevents;
+
+static const char *idname(unsigned id) {
+	static char tmp[16];
+
+	if (id < TRACE_NUM_IDS)
+		return names[id];
+	sprintf(tmp, "id %u", id);
+	return tmp;
+}
+
+static int from_dump(const uint8_t *data, size_t len) {
+	const size_t evsize = 12;
+	size_t i, j;
+
+	for (i = 0; i + 8 <= len; i += 4) {
+		if (get_be32(data + i) != TRACE_MAGIC)
+			continue;
+
+		const uint32_t n = get_be32(data + i + 4);
+		if (!n || n > TRACE_MAX_EVENTS || i + 8 + n * evsize > len)
+			continue;
+
+		for (j = 0; j < n; j++) {
+			const uint8_t *p = data + i + 8 + j * evsize;
+			ev[j].count = get_be32(p);
+			ev[j].kind = p[4];
+			ev[j].track = p[5];
+			ev[j].id = get_be16(p + 6);
+			ev[j].arg = get_be32(p + 8);
+		}
+		nevents = n;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int from_log(char *text) {
+	char *line;
+
+	nevents = 0;
+	for (line = strtok(text, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+		unsigned kind, track, id;
+		unsigned long count, arg;
+		const char *at = strstr(line, "@T ");
+
+		if (!at || sscanf(at, "@T %u %u %u %lx %lu", &kind, &track, &id,
+				  &count, &arg) != 5)
+			continue;
+		if (nevents >= TRACE_MAX_EVENTS)
+			break;
+
+		ev[nevents].count = count;
+		ev[nevents].kind = kind;
+		ev[nevents].track = track;
+		ev[nevents].id = id;
+		ev[nevents].arg = arg;
+		nevents++;
+	}
+
+	return nevents ? 0 : -1;
+}
+
+// Count is 32 bits and wraps every ~91 s; unwrap assuming monotonic order.
+static void unwrap(void) {
+	uint64_t base = 0;
+	unsigned i;
+
+	for (i = 0; i < nevents; i++) {
+		if (i && ev[i].count < ev[i - 1].count)
+			base += 1ULL << 32;
+		ticks[i] = base + ev[i].count;
+	}
+}
+
+static double usec(unsigned i) {
+	return (double) (ticks[i] - ticks[0]) * 1e6 / TRACE_COUNT_HZ;
+}
+
+static void write_json(FILE *f) {
+	unsigned i;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+		"\"args\":{\"name\":\"n64bootloader\"}}");
+	for (i = 0; i < TRACE_TRACKS; i++)
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i, tracks[i]);
+
+	for (i = 0; i < nevents; i++) {
+		fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\","
+			"\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+			idname(ev[i].id), ev[i].track == TRACE_CPU ? "phase" : "dma",
+			ev[i].kind == TRACE_BEGIN ? "B" : "E", usec(i), ev[i].track);
+		if (ev[i].track != TRACE_CPU && ev[i].kind == TRACE_BEGIN)
+			fprintf(f, ",\"args\":{\"bytes\":%u}", ev[i].arg);
+		fprintf(f, "}");
+	}
+
+	fprintf(f, "\n]}\n");
+}
+
+/* How much of the DMA time ran under a CPU phase other than the one that
+ * issued it, i.e. was actually hidden behind other work. */
+static void summary(void) {
+	int cpu[16], depth = 0, dma[TRACE_TRACKS];
+	double busy[TRACE_TRACKS] = { 0 }, hidden[TRACE_TRACKS] = { 0 };
+	unsigned i, t;
+
+	for (t = 0; t < TRACE_TRACKS; t++)
+		dma[t] = -1;
+	for (i = 0; i + 1 < nevents; i++) {
+		const double dt = usec(i + 1) - usec(i);
+
+		if (ev[i].track == TRACE_CPU) {
+			if (ev[i].kind == TRACE_BEGIN && depth < 16)
+				cpu[depth++] = ev[i].id;
+			else if (ev[i].kind == TRACE_END && depth)
+				depth--;
+		} else if (ev[i].track < TRACE_TRACKS) {
+			dma[ev[i].track] = ev[i].kind == TRACE_BEGIN ? ev[i].id : -1;
+		}
+
+		for (t = 1; t < TRACE_TRACKS; t++) {
+			if (dma[t] < 0)
+				continue;
+			busy[t] += dt;
+			if (depth && cpu[depth - 1] != dma[t])
+				hidden[t] += dt;
+		}
+	}
+
+	fprintf(stderr, "%u events, %.1f us total\n", nevents,
+		nevents ? usec(nevents - 1) : 0);
+	for (t = 1; t < TRACE_TRACKS; t++)
+		if (busy[t] > 0)
+			fprintf(stderr, "%s: %.1f us busy, %.1f us (%.0f%%) overlapped\n",
+				tracks[t], busy[t], hidden[t], 100 * hidden[t] / busy[t]);
+}
+
+int main(int argc, char **argv) {
+
+	if (argc < 2) {
+		printf("Usage: %s ramdump|debug.log [trace.json]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		puts("Can't open input");
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	const long len = ftell(f);
+	rewind(f);
+
+	uint8_t *data = malloc(len + 1);
+	if (!data || fread(data, 1, len, f) != (size_t) len)
+		abort();
+	data[len] = 0;
+	fclose(f);
+
+	if (from_dump(data, len) && from_log((char *) data)) {
+		puts("No trace found");
+		return 1;
+	}
+	free(data);
+
+	unwrap();
+
+	FILE *out = stdout;
+	if (argc == 3 && !(out = fopen(argv[2], "w"))) {
+		puts("Can't open output");
+		return 1;
+	}
+	write_json(out);
+	if (out != stdout)
+		fclose(out);
+
+	summary();
+
+	return 0;
+}